@@ -114,6 +114,28 @@ def send_RAW_order(text):
         return (4, -1, text)    # Failed operation
 
 
+def send_orders(texts, window=1):
+    # pipelined version of send_order: up to 'window' requests are sent before reading replies
+    # (see INFO;PIPELINE_WINDOW), replies come back in the same order
+    # returns a list of (error code, reply, order)
+    results = []
+    if not SerialPortAvailable:
+        print('The USB port is not available')
+        return [(4, -1, format(t)) for t in texts]
+    pending = []
+    port_serie.reset_input_buffer()
+    for text in texts + [None] * window:
+        if text is not None:
+            trame = format(text)
+            port_serie.write(trame.encode('ascii'))
+            pending.append(trame)
+        if len(pending) >= window or (text is None and pending):
+            trame = pending.pop(0)
+            ligne = str(port_serie.readline(), 'ascii')    # uses the port timeout
+            results.append((0, ligne, trame) if ligne else (2, -1, trame))
+    return results
+
+
 def val_message(message_reply):    # to extract the value from the USIS message
     MessageContent = message_reply.split(';')
     print(MessageContent)
@@ -160,6 +182,17 @@ class UVEX(cmd.Cmd):
         print('End of the script.\nGood bye!')
         quit()
 
+    def do_pipeline(self, arg):
+        '''pipeline message1 message2 ... - sends all messages without waiting each reply'''
+        orders = arg.split()
+        if orders:
+            reply, window, order = send_order('INFO;PIPELINE_WINDOW\n')
+            window = int(val_message(window)[1].split('*')[0]) if reply == 0 else 1
+            for reply, val, order in send_orders(orders, window):
+                print(f'Order sent: {order}... reply: {reply} - {order_err[reply]}\n... Message returned: {val}')
+        else:
+            print('Requires at least 1 message. Ex : pipeline GET;GRATING_ANGLE;VALUE GET;SLIT_ID;VALUE')
+
     def do_version(self, arg):
         '''Returns the firmware and protocol (USIS) version'''
         if (len(arg.split()) == 0):    # No argument is required
@@ -0,0 +1,135 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+"""
+#----------------------------------------------------------------------------------
+#----------------------------------------------------------------------------------
+Decoder of the USIS device trace (SYSTEM;TRACE).
+Usage:
+    python Trace-Python-USIS.py <serial port>   reads the trace from the device
+    python Trace-Python-USIS.py -               decodes M00;TRACE frames read on stdin
+Each record is printed with its sequence, time (us), delta with the previous record,
+session, event and values.
+#----------------------------------------------------------------------------------
+#----------------------------------------------------------------------------------
+"""
+
+# ----------------------------------------------------------------------------------
+# Loading libraries
+# ----------------------------------------------------------------------------------
+
+import struct    # record decoding
+import sys
+
+# ----------------------------------------------------------------------------------------------
+# Variables definition
+# ----------------------------------------------------------------------------------------------
+
+TIMEOUT_VALUE = 3
+
+# CMD_xxx (protocol.h)
+commands = ['OTHER', 'GET', 'SET', 'INFO', 'MGET', 'SUBSCRIBE', 'UNSUBSCRIBE', 'SYSTEM', 'CHANGED', 'WAIT', 'STOP', 'STREAM', 'CALIB', 'FACTORY_RESET']
+
+# BINARY_OP_xxx (protocol.h)
+binary_ops = {0x01: 'GET', 0x02: 'SET', 0x03: 'MGET', 0x7F: 'ASCII'}
+
+# TRACE_xxx (trace.h)
+events = {1: 'FRAME', 2: 'ERROR', 3: 'DISPATCH', 4: 'RESPONSE'}
+
+# ----------------------------------------------------------------------------------------------
+# Functions definition
+# ----------------------------------------------------------------------------------------------
+
+
+def command_name(a):
+    if a & 0x80:
+        return 'BIN:' + binary_ops.get(a & 0x7F, hex(a & 0x7F))
+    return commands[a] if a < len(commands) else str(a)
+
+
+def status_name(a):
+    if a == 0xFF:
+        return 'EVT'
+    if a == 0xFE:
+        return 'SMP'
+    if a & 0x80:
+        return 'C%02d' % (a & 0x7F)
+    return 'M%02d' % a
+
+
+def describe(event, a, b):
+    if event == 1:
+        return '%s, %d bytes' % (command_name(a), b)
+    if event == 2:
+        return 'C%02d, %d bytes received' % (a, b)
+    if event == 3:
+        return '%s, %s%d us' % (command_name(a), '>=' if b == 0xFFFF else '', b)
+    if event == 4:
+        return '%s, %d bytes' % (status_name(a), b)
+    return 'a=%d b=%d' % (a, b)
+
+
+def decode(first, items):
+    "decode the records of a frame, first is the sequence of the first one"
+    records = []
+    for i, item in enumerate(items):
+        time, event, a, b = struct.unpack('<IBBH', bytes.fromhex(item))
+        records.append((first + i, time, event >> 4, event & 0xF, a, b))
+    return records
+
+
+def parse_frame(line):
+    "M00;TRACE;<first>;<MORE|OK>;<records> -> (first, more, items)"
+    line = line.strip()
+    if '*' in line:
+        line = line[:line.index('*')]
+    parts = line.split(';')
+    if len(parts) < 4 or parts[0] != 'M00' or parts[1] != 'TRACE':
+        return None
+    items = parts[4].split(',') if len(parts) > 4 and parts[4] else []
+    return (int(parts[2]), parts[3] == 'MORE', items)
+
+
+def print_records(records):
+    last = None
+    for seq, time, session, event, a, b in records:
+        delta = '' if last is None else '+%d' % ((time - last) & 0xFFFFFFFF)
+        last = time
+        print('%8d %10d %10s  link %-2d %-8s %s' % (seq, time, delta, session, events.get(event, str(event)), describe(event, a, b)))
+
+
+def read_lines(lines):
+    records = []
+    for line in lines:
+        frame = parse_frame(line)
+        if frame is None:
+            continue
+        first, more, items = frame
+        if not records and first:
+            print('-- %d older records overwritten --' % first)
+        records += decode(first, items)
+        if not more:
+            break
+    return records
+
+
+def read_device(port):
+    import serial    # Manages the serial port
+    with serial.Serial(port, 115200, timeout=TIMEOUT_VALUE) as port_serie:
+        port_serie.reset_input_buffer()
+        port_serie.write(b'SYSTEM;TRACE\n')
+        lines = iter(lambda: str(port_serie.readline(), 'ascii'), '')
+        return read_lines(lines)
+
+
+# ----------------------------------------------------------------------------------------------
+# Main
+# ----------------------------------------------------------------------------------------------
+
+if __name__ == '__main__':
+    if len(sys.argv) != 2:
+        print(__doc__)
+        sys.exit(1)
+    if sys.argv[1] == '-':
+        print_records(read_lines(sys.stdin))
+    else:
+        print_records(read_device(sys.argv[1]))
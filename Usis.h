@@ -4,5 +4,10 @@
 #include "src/tools.h"
 #include "src/protocol.h"
 #include "src/properties.h"
+#include "src/scheduler.h"
+#include "src/coroutine.h"
+#include "src/storage.h"
+#include "src/profile.h"
+#include "src/trace.h"
 
 #endif // __USIS_H
\ No newline at end of file
@@ -1,3 +1,9 @@
 #include "src/protocol.cpp"
 #include "src/tools.cpp"
-#include "src/properties.cpp"
\ No newline at end of file
+#include "src/properties.cpp"
+#include "src/binary.cpp"
+#include "src/scheduler.cpp"
+#include "src/coroutine.cpp"
+#include "src/storage.cpp"
+#include "src/profile.cpp"
+#include "src/trace.cpp"
\ No newline at end of file
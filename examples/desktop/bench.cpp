@@ -0,0 +1,400 @@
+/**
+ * @file bench.cpp
+ * @desc Usis protocol benchmark (desktop build)
+ *
+ * build:
+ * 	g++ -O2 -DDESKTOPBM -I../.. bench.cpp ../../all.cpp ../../src/introspection.cpp ../../src/drivers/desktop.cpp -o bench
+ *
+ * requests are read from memory and responses are counted, nothing is printed
+ * but the results.
+ *
+ * stop latency: STOP;ALL is sent behind requests on a slow property (the handler
+ * takes SLOW_HANDLER_US), the time between the pass where the STOP is available and
+ * its answer is measured. STOP is dispatched by the parser, so the worst case is
+ * bounded by one handler already running (byte per pass), not by the queued requests.
+ *
+ * set/stop checks that a SET received before a STOP on the same property does not run
+ * after it (answered M15 when the STOP jumps the queue).
+ *
+ * binary TEXT set/get checks that a TEXT value set in binary framing ([length][chars])
+ * is stored and read back as sent.
+ *
+ * with -DUSIS_PROFILE, the stages of the bulk drain requests are printed (cf. SYSTEM;PROFILE)
+ **/
+
+#include <Usis.h>
+#include "memstream.h"
+
+PROPERTY_NAMES( "GRATING_ANGLE", "FOCUS_POSITION", "LIGHT_SOURCE", "SLOW", "NAME", "MOTOR" );
+
+#define SLOW_HANDLER_US 200
+
+static unsigned stops = 0;
+
+/**
+ * property handler taking time to answer, counts the stops
+ */
+
+static void slowHandler( PropertyMsg msg, Request* req, Response* res, rawValue* value ) {
+	if( msg == MsgStop ) {
+		stops++;
+		return;
+	}
+
+	long start = micros( );
+	while( micros( ) - start < SLOW_HANDLER_US ) {
+	}
+}
+
+static bool moving = false;
+
+/**
+ * motor handler, SET starts the motion, STOP ends it
+ */
+
+static void motorHandler( PropertyMsg msg, Request* req, Response* res, rawValue* value ) {
+	if( msg == MsgSet ) {
+		moving = true;
+	}
+	else if( msg == MsgStop ) {
+		moving = false;
+	}
+}
+
+PROPERTIES_START( )
+
+	PROPERTY_START( "GRATING_ANGLE", PROPERTY_TYPE_FLOAT, 0.0f, NULL )
+		PROPERTY_ATTR( "MIN", PROPERTY_TYPE_FLOAT|PROPERTY_FLAG_READONLY, 0.0f )
+		PROPERTY_ATTR( "MAX", PROPERTY_TYPE_FLOAT|PROPERTY_FLAG_READONLY, 360.0f )
+		PROPERTY_ATTR( "UNIT", PROPERTY_TYPE_CSTR|PROPERTY_FLAG_READONLY, "DEGREE" )
+	PROPERTY_END( )
+
+	PROPERTY_START( "FOCUS_POSITION", PROPERTY_TYPE_FLOAT, 0.0f, NULL )
+		PROPERTY_ATTR( "MIN", PROPERTY_TYPE_FLOAT|PROPERTY_FLAG_READONLY, 0.0f )
+		PROPERTY_ATTR( "MAX", PROPERTY_TYPE_FLOAT|PROPERTY_FLAG_READONLY, 360.0f )
+		PROPERTY_ATTR( "UNIT", PROPERTY_TYPE_CSTR|PROPERTY_FLAG_READONLY, "DEGREE" )
+	PROPERTY_END( )
+
+	PROPERTY_START( "LIGHT_SOURCE", PROPERTY_TYPE_ENUM, 0, NULL, "SKY", "FLAT", "CALIB", "DARK" )
+	PROPERTY_END( )
+
+	PROPERTY_START( "SLOW", PROPERTY_TYPE_INT, 0, slowHandler )
+	PROPERTY_END( )
+
+	PROPERTY_START( "NAME", PROPERTY_TYPE_CSTR, "", NULL )
+	PROPERTY_END( )
+
+	PROPERTY_START( "MOTOR", PROPERTY_TYPE_INT, 0, motorHandler )
+	PROPERTY_END( )
+
+PROPERTIES_END( );
+
+static MemoryStream stream;
+
+// requests sent by the benchmark
+static const char* requests[] = {
+	"GET;GRATING_ANGLE;VALUE\n",
+	"SET;FOCUS_POSITION;VALUE;12.5*20\n",
+	"GET;LIGHT_SOURCE;VALUE\n",
+	"GET;FOCUS_POSITION;MAX\n",
+};
+
+// same requests, binary framing (see binary.h)
+static const uint8_t binRequests[][8] = {
+	{ 3, BINARY_OP_GET, 0, 0 },
+	{ 7, BINARY_OP_SET, 1, 0, 0x00, 0x00, 0x48, 0x41 }, // 12.5f
+	{ 3, BINARY_OP_GET, 2, 0 },
+	{ 3, BINARY_OP_GET, 1, 2 },
+};
+
+#define BENCH_FRAMES 100000
+
+static uint8_t input[BENCH_FRAMES * 40];
+static uint8_t binInput[BENCH_FRAMES * 16];
+
+/**
+ * message handler
+ */
+
+static void handleMessage( Request* req, Response* res ) {
+	processProperty( req, res );
+}
+
+/**
+ * build the input buffer
+ * @return buffer length
+ */
+
+static size_t buildInput( ) {
+	size_t len = 0;
+	for( int i = 0; i < BENCH_FRAMES; i++ ) {
+		const char* r = requests[i % count_of( requests )];
+		size_t l = strlen( r );
+		memcpy( input + len, r, l );
+		len += l;
+	}
+
+	return len;
+}
+
+/**
+ * encode a binary frame: payload + crc16, COBS, EOT
+ * @return frame length
+ */
+
+static size_t encodeFrame( const uint8_t* payload, unsigned len, uint8_t* frame ) {
+	uint8_t data[16];
+	memcpy( data, payload, len );
+	uint16_t crc = crc16( data, len );
+	data[len] = crc & 0xff;
+	data[len + 1] = crc >> 8;
+
+	size_t flen = cobs_encode( data, len + 2, frame );
+	frame[flen++] = PROTOCOL_BINARY_EOT;
+	return flen;
+}
+
+/**
+ * build the binary input buffer
+ * @return buffer length
+ */
+
+static size_t buildBinaryInput( ) {
+	size_t len = 0;
+	for( int i = 0; i < BENCH_FRAMES; i++ ) {
+		const uint8_t* r = binRequests[i % count_of( binRequests )];
+		len += encodeFrame( r + 1, r[0], binInput + len );
+	}
+
+	return len;
+}
+
+/**
+ * run the loop until all input is consumed
+ */
+
+/**
+ * count the answers that are not M00, the benchmark requests must all succeed
+ * a binary frame starts with the COBS code 1 when its status is 0
+ */
+
+static unsigned errors;
+
+static void onReceiveFrame( MemoryStream* s, const char* frame ) {
+	if( s->frameEnd == PROTOCOL_EOT ? strncmp( frame, "M00", 3 ) != 0 : frame[0] != 1 ) {
+		errors++;
+	}
+}
+
+static void runReceive( const char* title, const uint8_t* data, size_t len, size_t window, uint8_t frameEnd = PROTOCOL_EOT ) {
+	stream.reset( data, len, window );
+	stream.frameEnd = frameEnd;
+	stream.onFrame = onReceiveFrame;
+	errors = 0;
+
+	unsigned long passes = 0;
+	long start = micros( );
+
+	while( !stream.eof( ) ) {
+		stream.tick( );
+		processMessages( &stream, handleMessage );
+		passes++;
+	}
+
+	long elapsed = micros( ) - start;
+	const unsigned frames = stream.frames ? stream.frames : 1;
+	printf( "%-22s %8u frames %10lu loop passes %10.0f frames/s %6.1f bytes/transaction %4.1f writes/response %u errors\n", title, stream.frames, passes, stream.frames * 1e6 / ( elapsed ? elapsed : 1 ),
+			(double)( len + stream.bytesOut ) / frames, (double)stream.writes / frames, errors );
+}
+
+/**
+ * stop latency
+ */
+
+#define STOP_ROUNDS 1000
+
+static const char* stopRound = "GET;SLOW;VALUE\nGET;SLOW;VALUE\nGET;SLOW;VALUE\nSTOP;ALL\n";
+
+static long stopAnswered;
+static unsigned framesBeforeStop;
+
+static void onStopFrame( MemoryStream* s, const char* frame ) {
+	if( strncmp( frame, "M00;STOP;ALL", 12 ) == 0 ) {
+		stopAnswered = micros( );
+	}
+	else if( !stopAnswered ) {
+		framesBeforeStop++;
+	}
+}
+
+static void runStopLatency( const char* title, size_t window ) {
+	const size_t len = strlen( stopRound );
+	const size_t stopEnd = len; // STOP;ALL is the last request of the round
+
+	long worst = 0;
+	long total = 0;
+	unsigned worstAhead = 0;
+	stops = 0;
+
+	for( int i = 0; i < STOP_ROUNDS; i++ ) {
+		stream.reset( (const uint8_t*)stopRound, len, window );
+		stream.onFrame = onStopFrame;
+		stopAnswered = 0;
+		framesBeforeStop = 0;
+
+		long available = 0;
+		while( !stream.eof( ) || !stopAnswered ) {
+			if( !available && stream.nextEnd( ) >= stopEnd ) {
+				available = micros( );
+			}
+
+			stream.tick( );
+			processMessages( &stream, handleMessage );
+		}
+
+		long latency = stopAnswered - available;
+		total += latency;
+		if( latency > worst ) {
+			worst = latency;
+		}
+
+		if( framesBeforeStop > worstAhead ) {
+			worstAhead = framesBeforeStop;
+		}
+	}
+
+	printf( "%-22s %8u rounds  %8.1f us avg %8ld us worst %4u answers ahead (%u stops, handler %d us)\n", title, STOP_ROUNDS, (double)total / STOP_ROUNDS, worst, worstAhead, stops, SLOW_HANDLER_US );
+}
+
+/**
+ * binary TEXT round trip: SET NAME [2]"HI" then GET NAME, both answers
+ * must carry the text as sent: [0][4][0][state][3][2]"HI"
+ */
+
+static uint8_t answer[PROTOCOL_MAX_RESP_LEN + 8];
+static size_t answerLen;
+
+static void onBinaryFrame( MemoryStream* s, const char* frame ) {
+	answerLen = cobs_decode( (const uint8_t*)frame, strlen( frame ), answer );
+}
+
+static bool binaryRoundTrip( const uint8_t* request, unsigned len ) {
+	uint8_t frame[32];
+	size_t flen = encodeFrame( request, len, frame );
+
+	stream.reset( frame, flen, 0 );
+	stream.frameEnd = PROTOCOL_BINARY_EOT;
+	stream.onFrame = onBinaryFrame;
+	answerLen = 0;
+
+	stream.tick( );
+	processMessages( &stream, handleMessage );
+
+	static const uint8_t expected[] = { 0, 4, 0, 0, PROPERTY_TYPE_CSTR, 2, 'H', 'I' };
+	return answerLen == sizeof( expected ) + 2 && memcmp( answer, expected, sizeof( expected ) ) == 0;
+}
+
+static void runTextRoundTrip( const char* title ) {
+	static const uint8_t set[] = { BINARY_OP_SET, 4, 0, 2, 'H', 'I' };
+	static const uint8_t get[] = { BINARY_OP_GET, 4, 0 };
+
+	bool ok = binaryRoundTrip( set, sizeof( set ) ) && binaryRoundTrip( get, sizeof( get ) );
+	printf( "%-22s %s\n", title, ok ? "OK" : "FAILED" );
+}
+
+/**
+ * SET then STOP on the same property: the motor must not move after the STOP
+ * when both are received in the same pass, the SET is answered M15
+ */
+
+static const char* setStop = "SET;MOTOR;VALUE;5\nSTOP;MOTOR\n";
+
+static char answers[2][32];
+static unsigned answerCount;
+
+static void onSetStopFrame( MemoryStream* s, const char* frame ) {
+	if( answerCount < 2 ) {
+		strncpy( answers[answerCount], frame, sizeof( answers[0] ) - 1 );
+	}
+
+	answerCount++;
+}
+
+static void runSetStop( const char* title, size_t window, const char* first, const char* second ) {
+	stream.reset( (const uint8_t*)setStop, strlen( setStop ), window );
+	stream.onFrame = onSetStopFrame;
+	answerCount = 0;
+	moving = false;
+
+	while( !stream.eof( ) ) {
+		stream.tick( );
+		processMessages( &stream, handleMessage );
+	}
+
+	bool ok = !moving && answerCount == 2 && strncmp( answers[0], first, strlen( first ) ) == 0 && strncmp( answers[1], second, strlen( second ) ) == 0;
+	printf( "%-22s %s\n", title, ok ? "OK" : "FAILED" );
+}
+
+/**
+ * switch the session framing
+ */
+
+static void setFraming( const char* request ) {
+	stream.reset( (const uint8_t*)request, strlen( request ), 0 );
+	stream.tick( );
+	processMessages( &stream, handleMessage );
+}
+
+#ifdef USIS_PROFILE
+
+static void onProfileFrame( MemoryStream* s, const char* frame ) {
+	printf( "%s\n", frame );
+}
+
+/**
+ * print the profile of the requests since the last reset
+ */
+
+static void printProfile( ) {
+	stream.reset( (const uint8_t*)"SYSTEM;PROFILE\n", 15, 0 );
+	stream.onFrame = onProfileFrame;
+	stream.tick( );
+	processMessages( &stream, handleMessage );
+}
+
+#endif
+
+/**
+ *
+ */
+
+void init( ) {
+	size_t len = buildInput( );
+	size_t binLen = buildBinaryInput( );
+
+	runReceive( "receive, byte per pass", input, len, 1 );
+
+#ifdef USIS_PROFILE
+	setFraming( "SYSTEM;PROFILE_RESET\n" );
+#endif
+
+	runReceive( "receive, bulk drain", input, len, 0 );
+
+#ifdef USIS_PROFILE
+	printProfile( );
+#endif
+
+	runStopLatency( "stop, byte per pass", 1 );
+	runStopLatency( "stop, bulk drain", 0 );
+	runSetStop( "set/stop, byte pass", 1, "M00;MOTOR;VALUE", "M00;MOTOR;VALUE" );
+	runSetStop( "set/stop, bulk drain", 0, "M00;MOTOR;VALUE", "M15;STOPPED" );
+
+	setFraming( "SYSTEM;FRAMING;BINARY\n" );
+	runReceive( "binary framing", binInput, binLen, 0, PROTOCOL_BINARY_EOT );
+	runTextRoundTrip( "binary TEXT set/get" );
+
+	exit( 0 );
+}
+
+void loop( ) {
+}
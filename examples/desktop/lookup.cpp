@@ -0,0 +1,175 @@
+/**
+ * @file lookup.cpp
+ * @desc property lookup benchmark (desktop build)
+ *
+ * build, list registry (no hash table):
+ * 	g++ -O2 -DDESKTOPBM -DPROPERTY_HASH_SIZE=0 -I../.. lookup.cpp ../../all.cpp ../../src/introspection.cpp ../../src/drivers/desktop.cpp -o lookup
+ *
+ * without -DPROPERTY_HASH_SIZE=0 the same lookups go through the hash table.
+ *
+ * names are looked up like the parser does (hash already computed), with a skewed
+ * traffic: SKEW_HOT % of the lookups go to the 3 properties defined last, the others
+ * are spread over the remaining ones. "definition order" never reorders the list,
+ * "self-organizing" calls reorderProperties() as the messages loop does.
+ **/
+
+#include <Usis.h>
+
+PROPERTIES_START( )
+
+	PROPERTY_START( "DEVICE_NAME", PROPERTY_TYPE_CSTR|PROPERTY_FLAG_READONLY, "ALPY", NULL )
+	PROPERTY_END( )
+
+	PROPERTY_START( "SOFTWARE_VERSION", PROPERTY_TYPE_CSTR|PROPERTY_FLAG_READONLY, "1.0", NULL )
+	PROPERTY_END( )
+
+	PROPERTY_START( "PROTOCOL_VERSION", PROPERTY_TYPE_CSTR|PROPERTY_FLAG_READONLY, "1.0", NULL )
+	PROPERTY_END( )
+
+	PROPERTY_START( "SERIAL_NUMBER", PROPERTY_TYPE_CSTR|PROPERTY_FLAG_READONLY, "0001", NULL )
+	PROPERTY_END( )
+
+	PROPERTY_START( "BOARD_REVISION", PROPERTY_TYPE_CSTR|PROPERTY_FLAG_READONLY, "B", NULL )
+	PROPERTY_END( )
+
+	PROPERTY_START( "TEMPERATURE", PROPERTY_TYPE_FLOAT|PROPERTY_FLAG_READONLY, 0.0f, NULL )
+	PROPERTY_END( )
+
+	PROPERTY_START( "HUMIDITY", PROPERTY_TYPE_FLOAT|PROPERTY_FLAG_READONLY, 0.0f, NULL )
+	PROPERTY_END( )
+
+	PROPERTY_START( "POWER_SUPPLY", PROPERTY_TYPE_FLOAT|PROPERTY_FLAG_READONLY, 12.0f, NULL )
+	PROPERTY_END( )
+
+	PROPERTY_START( "UPTIME", PROPERTY_TYPE_INT|PROPERTY_FLAG_READONLY, 0, NULL )
+	PROPERTY_END( )
+
+	PROPERTY_START( "GRATING_ID", PROPERTY_TYPE_INT, 0, NULL )
+	PROPERTY_END( )
+
+	PROPERTY_START( "GRATING_WAVELENGTH", PROPERTY_TYPE_FLOAT, 0.0f, NULL )
+	PROPERTY_END( )
+
+	PROPERTY_START( "GRATING_DENSITY", PROPERTY_TYPE_INT|PROPERTY_FLAG_READONLY, 600, NULL )
+	PROPERTY_END( )
+
+	PROPERTY_START( "SLIT_ID", PROPERTY_TYPE_INT, 0, NULL )
+	PROPERTY_END( )
+
+	PROPERTY_START( "SLIT_WIDTH", PROPERTY_TYPE_FLOAT, 23.0f, NULL )
+	PROPERTY_END( )
+
+	PROPERTY_START( "SLIT_ANGLE", PROPERTY_TYPE_FLOAT, 0.0f, NULL )
+	PROPERTY_END( )
+
+	PROPERTY_START( "FOCUS_TEMPERATURE", PROPERTY_TYPE_FLOAT|PROPERTY_FLAG_READONLY, 0.0f, NULL )
+	PROPERTY_END( )
+
+	PROPERTY_START( "FILTER_POSITION", PROPERTY_TYPE_INT, 0, NULL )
+	PROPERTY_END( )
+
+	PROPERTY_START( "SHUTTER", PROPERTY_TYPE_ENUM, 0, NULL, "CLOSED", "OPEN" )
+	PROPERTY_END( )
+
+	PROPERTY_START( "FLAT_LAMP_TIME", PROPERTY_TYPE_INT|PROPERTY_FLAG_READONLY, 0, NULL )
+	PROPERTY_END( )
+
+	PROPERTY_START( "CALIB_LAMP_TIME", PROPERTY_TYPE_INT|PROPERTY_FLAG_READONLY, 0, NULL )
+	PROPERTY_END( )
+
+	PROPERTY_START( "GUIDE_CAMERA", PROPERTY_TYPE_ENUM, 0, NULL, "OFF", "ON" )
+	PROPERTY_END( )
+
+	PROPERTY_START( "FAN", PROPERTY_TYPE_ENUM, 0, NULL, "OFF", "ON" )
+	PROPERTY_END( )
+
+	PROPERTY_START( "GRATING_ANGLE", PROPERTY_TYPE_FLOAT, 0.0f, NULL )
+	PROPERTY_END( )
+
+	PROPERTY_START( "FOCUS_POSITION", PROPERTY_TYPE_FLOAT, 0.0f, NULL )
+	PROPERTY_END( )
+
+	PROPERTY_START( "LIGHT_SOURCE", PROPERTY_TYPE_ENUM, 0, NULL, "SKY", "FLAT", "CALIB", "DARK" )
+	PROPERTY_END( )
+
+PROPERTIES_END( );
+
+#define HOT_COUNT 3
+#define LOOKUPS 10000000
+
+static cstr names[64];
+static uint16_t hashes[64];
+static unsigned nameCount = 0;
+
+/**
+ * pseudo random, same sequence for all runs
+ */
+
+static uint32_t seed;
+
+static uint32_t next( ) {
+	seed = seed * 1664525u + 1013904223u;
+	return seed >> 8;
+}
+
+/**
+ * @param skew - % of the lookups going to the hot properties, 0 for uniform
+ * @param reorder - call reorderProperties between lookups
+ */
+
+static void run( const char* title, unsigned skew, bool reorder ) {
+	static uint16_t sequence[LOOKUPS];
+
+	seed = 1;
+	for( unsigned i = 0; i < LOOKUPS; i++ ) {
+		uint32_t r = next( );
+		if( skew && r % 100 < skew ) {
+			sequence[i] = nameCount - HOT_COUNT + ( r >> 7 ) % HOT_COUNT;
+		}
+		else {
+			sequence[i] = ( r >> 7 ) % ( skew ? nameCount - HOT_COUNT : nameCount );
+		}
+	}
+
+	unsigned found = 0;
+	long start = micros( );
+
+	for( unsigned i = 0; i < LOOKUPS; i++ ) {
+		const unsigned n = sequence[i];
+		found += findProperty( names[n], hashes[n] ) ? 1 : 0;
+
+		if( reorder ) {
+			reorderProperties( );
+		}
+	}
+
+	long elapsed = micros( ) - start;
+	printf( "%-32s %8u lookups %8.1f ns/lookup\n", title, found, elapsed * 1000.0 / LOOKUPS );
+}
+
+/**
+ *
+ */
+
+void init( ) {
+	for( rawProperty* p = properties; p; p = p->next ) {
+		names[nameCount] = propName( p );
+		hashes[nameCount] = propHash( p );
+		nameCount++;
+	}
+
+	printf( "%u properties, hash table size %d\n", nameCount, PROPERTY_HASH_SIZE );
+
+	run( "95% hot, definition order", 95, false );
+	run( "95% hot, self-organizing", 95, true );
+	run( "uniform, definition order", 0, false );
+	run( "uniform, self-organizing", 0, true );
+
+	// introspection order is kept
+	printf( "property #0 is %s\n", propName( getPropertyByIndex( 0, true ) ) );
+
+	exit( 0 );
+}
+
+void loop( ) {
+}
@@ -0,0 +1,124 @@
+/**
+ * @file memstream.h
+ * @desc in memory stream for desktop examples
+ **/
+
+#ifndef __USIS_MEMSTREAM_H
+#define __USIS_MEMSTREAM_H
+
+#include <Usis.h>
+
+/**
+ * in memory stream
+ * window is the max number of bytes available on each loop pass,
+ * 0 means everything.
+ */
+
+class MemoryStream : public Stream {
+	const uint8_t* m_data;
+	size_t m_len;
+	size_t m_pos;
+	size_t m_window;
+	size_t m_budget;
+
+public:
+	unsigned frames; // count of frames written
+	unsigned long bytesOut; // count of bytes written
+	unsigned long writes; // count of stream write calls
+	uint8_t frameEnd; // end of frame marker
+	void ( *onFrame )( MemoryStream* stream, const char* frame ); // called on each written frame, may be NULL
+
+	char out[PROTOCOL_MAX_RESP_LEN + 8]; // frame being written
+	unsigned outLen;
+
+	MemoryStream( ) {
+		reset( NULL, 0, 0 );
+	}
+
+	void reset( const uint8_t* data, size_t len, size_t window ) {
+		m_data = data;
+		m_len = len;
+		m_pos = 0;
+		m_window = window;
+		m_budget = 0;
+		frames = 0;
+		bytesOut = 0;
+		writes = 0;
+		frameEnd = PROTOCOL_EOT;
+		onFrame = NULL;
+		outLen = 0;
+	}
+
+	// start of a new loop pass
+	void tick( ) {
+		m_budget = m_window ? m_window : m_len;
+	}
+
+	bool eof( ) const {
+		return m_pos >= m_len;
+	}
+
+	// bytes available at the next loop pass end before this position
+	size_t nextEnd( ) const {
+		size_t budget = m_window ? m_window : m_len;
+		return m_pos + budget < m_len ? m_pos + budget : m_len;
+	}
+
+	virtual void write( const uint8_t* buffer, size_t length ) override {
+		writes++;
+		for( size_t i = 0; i < length; i++ ) {
+			put( buffer[i] );
+		}
+	}
+
+	virtual void write( uint8_t b ) override {
+		writes++;
+		put( b );
+	}
+
+	void put( uint8_t b ) {
+		bytesOut++;
+
+		if( b == frameEnd ) {
+			frames++;
+
+			if( onFrame ) {
+				out[outLen] = 0;
+				onFrame( this, out );
+			}
+
+			outLen = 0;
+		}
+		else if( outLen < sizeof( out ) - 1 ) {
+			out[outLen++] = b;
+		}
+	}
+
+	virtual int read( ) override {
+		if( !available( ) ) {
+			return -1;
+		}
+
+		m_budget--;
+		return m_data[m_pos++];
+	}
+
+	virtual int available( ) override {
+		size_t left = m_len - m_pos;
+		return left < m_budget ? left : m_budget;
+	}
+
+	virtual size_t readBytes( char* buffer, size_t length ) override {
+		size_t count = available( );
+		if( count > length ) {
+			count = length;
+		}
+
+		memcpy( buffer, m_data + m_pos, count );
+		m_pos += count;
+		m_budget -= count;
+		return count;
+	}
+};
+
+#endif
@@ -0,0 +1,81 @@
+/**
+ * @file sessions.cpp
+ * @desc several protocol sessions served from the same loop (desktop build)
+ *
+ * build:
+ * 	g++ -O2 -DDESKTOPBM -I../.. sessions.cpp ../../all.cpp ../../src/introspection.cpp ../../src/drivers/desktop.cpp -o sessions
+ *
+ * each link receives a few bytes per loop pass so requests of all links
+ * are interleaved, every link still gets its own answers.
+ **/
+
+#include <Usis.h>
+#include "memstream.h"
+
+PROPERTIES_START( )
+
+	PROPERTY_START( "GRATING_ANGLE", PROPERTY_TYPE_FLOAT, 0.0f, NULL )
+		PROPERTY_ATTR( "UNIT", PROPERTY_TYPE_CSTR|PROPERTY_FLAG_READONLY, "DEGREE" )
+	PROPERTY_END( )
+
+	PROPERTY_START( "LIGHT_SOURCE", PROPERTY_TYPE_ENUM, 0, NULL, "SKY", "FLAT", "CALIB", "DARK" )
+	PROPERTY_END( )
+
+PROPERTIES_END( );
+
+// what each link sends
+static const char* scripts[] = {
+	"GET;GRATING_ANGLE;VALUE\nSET;GRATING_ANGLE;VALUE;45.3\nGET;GRATING_ANGLE;UNIT\n",
+	"GET;LIGHT_SOURCE;VALUE*01\nSET;LIGHT_SOURCE;VALUE;FLAT\nINFO;PROPERTY_COUNT\n",
+	"GET;UNKNOWN;VALUE\nBAD*00\nGET;LIGHT_SOURCE;VALUE\n",
+};
+
+#define LINK_COUNT count_of( scripts )
+
+static MemoryStream streams[LINK_COUNT];
+
+/**
+ * print the responses with the link number
+ */
+
+static void onFrame( MemoryStream* stream, const char* frame ) {
+	printf( "link %d < %s\n", (int)( stream - streams ), frame );
+}
+
+static void handleMessage( Request* req, Response* res ) {
+	processProperty( req, res );
+}
+
+/**
+ *
+ */
+
+void init( ) {
+	static ProtocolSession* sessions[LINK_COUNT];
+
+	for( unsigned i = 0; i < LINK_COUNT; i++ ) {
+		streams[i].reset( (const uint8_t*)scripts[i], strlen( scripts[i] ), 5 );
+		streams[i].onFrame = onFrame;
+		sessions[i] = new ProtocolSession( &streams[i] );
+	}
+
+	// round robin on all links
+	bool running = true;
+	while( running ) {
+		running = false;
+
+		for( unsigned i = 0; i < LINK_COUNT; i++ ) {
+			streams[i].tick( );
+			processMessages( sessions[i], handleMessage );
+
+			running |= !streams[i].eof( );
+		}
+
+		processIdle( );
+	}
+
+	exit( 0 );
+}
+
+void loop( ) {
+}
@@ -0,0 +1,337 @@
+/**
+ * @file binary.cpp
+ * @desc Usis binary framing handing
+ *
+ * @author Etienne Cochard ecochard@r-libre.fr
+ * @version 1.0
+ **/
+
+#include "binary.h"
+#include "introspection.h"
+#include "storage.h"
+#include "profile.h"
+#include "coroutine.h"
+
+// max length of a text value in binary frames
+#define BINARY_MAX_TEXT 64
+
+/**
+ * little endian helpers
+ */
+
+static uint8_t* putU32( uint8_t* p, uint32_t v ) {
+	*p++ = v & 0xff;
+	*p++ = ( v >> 8 ) & 0xff;
+	*p++ = ( v >> 16 ) & 0xff;
+	*p++ = ( v >> 24 ) & 0xff;
+	return p;
+}
+
+static uint32_t getU32( const uint8_t* p ) {
+	return (uint32_t)p[0] | ( (uint32_t)p[1] << 8 ) | ( (uint32_t)p[2] << 16 ) | ( (uint32_t)p[3] << 24 );
+}
+
+/**
+ * encode an attribute value: [state][type][value]
+ */
+
+static unsigned encodeBinaryValue( uint8_t* p, rawAttribute* a ) {
+	uint8_t* start = p;
+	const uint8_t type = a->value.attrs & PROPERTY_TYPE_MASK;
+
+	*p++ = ( a->value.attrs & PROPERTY_STATE_MASK ) >> 3;
+	*p++ = type;
+
+	switch( type ) {
+		case PROPERTY_TYPE_INT:
+		case PROPERTY_TYPE_ENUM: {
+			p = putU32( p, (uint32_t)a->value.ival );
+			break;
+		}
+
+		case PROPERTY_TYPE_FLOAT: {
+			uint32_t v;
+			memcpy( &v, &a->value.fval, sizeof( v ) );
+			p = putU32( p, v );
+			break;
+		}
+
+		case PROPERTY_TYPE_CSTR: {
+			cstr s = a->value.sval ? a->value.sval : "";
+			size_t len = strlen( s );
+			if( len > BINARY_MAX_TEXT ) {
+				len = BINARY_MAX_TEXT;
+			}
+
+			*p++ = len;
+			memcpy( p, s, len );
+			p += len;
+			break;
+		}
+	}
+
+	return p - start;
+}
+
+/**
+ * encode an attribute: [prop][attr][state][type][value]
+ */
+
+unsigned encodeBinaryAttribute( uint8_t* p, uint8_t propIdx, uint8_t attrIdx, rawAttribute* a ) {
+	p[0] = propIdx;
+	p[1] = attrIdx;
+	return 2 + encodeBinaryValue( p + 2, a );
+}
+
+/**
+ * encode a STREAM sample: [prop][attr][state][type][value][timestamp]
+ */
+
+unsigned encodeBinarySample( uint8_t* p, uint8_t propIdx, rawAttribute* a, uint32_t timestamp ) {
+	unsigned len = encodeBinaryAttribute( p, propIdx, 0, a );
+	putU32( p + len, timestamp );
+	return len + 4;
+}
+
+/**
+ * find the property & attribute given by their indexes
+ * send the error if not found
+ */
+
+static rawAttribute* getBinaryAttribute( const uint8_t* data, Response* res, rawProperty** prop ) {
+	*prop = getPropertyByIndex( data[0], true );
+	if( !*prop ) {
+		res->sendError( "M01", "UNKNOWN PROPERTY" );
+		return NULL;
+	}
+
+	rawAttribute* attr = getAttributeByIndex( *prop, data[1] );
+	if( !attr ) {
+		res->sendError( "M02", "UNKNOWN ATTRIBUTE" );
+		return NULL;
+	}
+
+	return attr;
+}
+
+/**
+ * send the attribute value
+ */
+
+static void sendBinaryAttribute( Response* res, uint8_t propIdx, uint8_t attrIdx, rawAttribute* attr ) {
+	uint8_t payload[1 + 4 + 1 + BINARY_MAX_TEXT];
+	payload[0] = 0;
+
+	unsigned len = 1 + encodeBinaryAttribute( payload + 1, propIdx, attrIdx, attr );
+	res->sendBinary( payload, len );
+}
+
+/**
+ * handle BINARY_OP_GET
+ */
+
+static int processBinaryGet( Request* req, Response* res ) {
+	const uint8_t* data = req->getData( );
+	if( req->getDataLength( ) < 3 ) {
+		res->sendError( "C02", "BAD REQUEST" );
+		return -1;
+	}
+
+	rawProperty* prop;
+	rawAttribute* attr = getBinaryAttribute( data + 1, res, &prop );
+	if( !attr ) {
+		return -1;
+	}
+
+	pfnHandler handler = propHandler( prop );
+	if( handler && attr == prop->attrs ) {
+		PROFILE_SCOPE( PROFILE_HANDLER );
+		handler( MsgGet, req, res, &attr->value );
+	}
+
+	if( !res->isDone( ) ) {
+		sendBinaryAttribute( res, data[1], data[2], attr );
+	}
+
+	return 0;
+}
+
+/**
+ * handle BINARY_OP_SET
+ */
+
+static int processBinarySet( Request* req, Response* res ) {
+	const uint8_t* data = req->getData( );
+	unsigned len = req->getDataLength( );
+
+	if( len < 3 ) {
+		res->sendError( "C02", "BAD REQUEST" );
+		return -1;
+	}
+
+	rawProperty* prop;
+	rawAttribute* attr = getBinaryAttribute( data + 1, res, &prop );
+	if( !attr ) {
+		return -1;
+	}
+
+	const uint8_t* v = data + 3;
+	len -= 3;
+
+#ifdef USIS_COROUTINES
+	// the value is not stored if the handler cannot run
+	if( attr == prop->attrs && propCoroutine( prop ) && !coroutineAvailable( ) ) {
+		res->sendError( "M14", "NO TASK SLOT" );
+		return -1;
+	}
+#endif
+
+	int rc = -2;
+	switch( attr->value.attrs & PROPERTY_TYPE_MASK ) {
+		case PROPERTY_TYPE_INT: {
+			if( len == 4 ) {
+				rc = setAttr( attr, (int)(int32_t)getU32( v ) );
+			}
+			break;
+		}
+
+		case PROPERTY_TYPE_ENUM: {
+			if( len == 4 ) {
+				int32_t idx = (int32_t)getU32( v );
+				rc = ( idx >= 0 && idx < attrEnumCount( attr ) ) ? setAttr( attr, (int)idx ) : -3;
+			}
+			break;
+		}
+
+		case PROPERTY_TYPE_FLOAT: {
+			if( len == 4 ) {
+				uint32_t bits = getU32( v );
+				float f;
+				memcpy( &f, &bits, sizeof( f ) );
+				rc = setAttr( attr, f );
+			}
+			break;
+		}
+
+		case PROPERTY_TYPE_CSTR: {
+			// [length][chars], 0 terminated by the protocol, copied as the request buffer is reused
+			if( len >= 1 && v[0] == len - 1 ) {
+				rc = v[0] <= PROPERTY_TEXT_LEN ? setAttrText( attr, (cstr)( v + 1 ) ) : -3;
+			}
+			break;
+		}
+	}
+
+	switch( rc ) {
+		case -1: {
+			res->sendError( "M03", "READONLY" );
+			return -1;
+		}
+
+		case -2: {
+			res->sendError( "M04", "BAD VALUE TYPE" );
+			return -1;
+		}
+
+		case -3: {
+			res->sendError( "M08", "BAD VALUE" );
+			return -1;
+		}
+	}
+
+	saveAttribute( prop, attr );
+
+	pfnHandler handler = propHandler( prop );
+	if( handler && attr == prop->attrs ) {
+		PROFILE_SCOPE( PROFILE_HANDLER );
+		handler( MsgSet, req, res, &attr->value );
+	}
+
+	if( !res->isDone( ) ) {
+		sendBinaryAttribute( res, data[1], data[2], attr );
+	}
+
+	return 0;
+}
+
+/**
+ * handle BINARY_OP_MGET
+ * items that do not fit in a frame are sent in the next one (more = 1)
+ */
+
+static int processBinaryMGet( Request* req, Response* res ) {
+	const uint8_t* data = req->getData( );
+	unsigned count = ( req->getDataLength( ) - 1 ) / 2;
+
+	static uint8_t payload[PROTOCOL_MAX_RESP_LEN];
+	const unsigned maxItem = 5 + 1 + BINARY_MAX_TEXT;
+
+	unsigned len = 3;
+	payload[0] = 0;
+	payload[1] = 0;
+
+	for( unsigned i = 0; i < count; i++ ) {
+		const uint8_t* item = data + 1 + i * 2;
+
+		if( len + maxItem > sizeof( payload ) ) {
+			payload[2] = 1;
+			res->sendBinary( payload, len );
+
+			payload[1] = i;
+			len = 3;
+		}
+
+		rawProperty* prop = getPropertyByIndex( item[0], true );
+		rawAttribute* attr = prop ? getAttributeByIndex( prop, item[1] ) : NULL;
+
+		payload[len++] = item[0];
+		payload[len++] = item[1];
+
+		if( !attr ) {
+			payload[len++] = prop ? 2 : 1; // M02 or M01
+		}
+		else {
+			pfnHandler handler = propHandler( prop );
+			if( handler && attr == prop->attrs ) {
+				// the handler sees a GET of the item, what it sends is dropped
+				const uint8_t op[3] = { BINARY_OP_GET, item[0], item[1] };
+				Request get( op, sizeof( op ), req->getSession( ) );
+				Response scratch( NULL, true, true );
+
+				PROFILE_SCOPE( PROFILE_HANDLER );
+				handler( MsgGet, &get, &scratch, &attr->value );
+			}
+
+			payload[len++] = 0;
+			len += encodeBinaryValue( payload + len, attr );
+		}
+	}
+
+	payload[2] = 0;
+	res->sendBinary( payload, len );
+	return 0;
+}
+
+/**
+ * process a binary request
+ */
+
+int processBinary( Request* req, Response* res ) {
+
+	switch( req->getData( )[0] ) {
+		case BINARY_OP_GET: {
+			return processBinaryGet( req, res );
+		}
+
+		case BINARY_OP_SET: {
+			return processBinarySet( req, res );
+		}
+
+		case BINARY_OP_MGET: {
+			return processBinaryMGet( req, res );
+		}
+	}
+
+	res->sendError( "M06", "UNKNOWN COMMAND" );
+	return -1;
+}
@@ -0,0 +1,52 @@
+/**
+ * @file binary.h
+ * @desc Usis binary framing handing
+ *
+ * @author Etienne Cochard ecochard@r-libre.fr
+ * @version 1.0
+ **/
+
+#ifndef __USIS_BINARY_H
+#define __USIS_BINARY_H
+
+#include "properties.h"
+
+/**
+ * process a binary request (see BINARY_OP_xxx)
+ *
+ * requests:
+ * 	[BINARY_OP_GET][prop][attr]
+ * 	[BINARY_OP_SET][prop][attr][value]
+ * 	[BINARY_OP_MGET][prop][attr][prop][attr]...
+ *
+ * responses:
+ * 	[status][prop][attr][state][type][value]
+ * 	[status][first][more]([prop][attr][status]([state][type][value]))... for MGET
+ * 	[status] on error
+ *
+ * prop & attr are the introspection indexes
+ * values are little endian: int32 for INT & ENUM, float32 for FLOAT, [len][chars] for TEXT
+ *
+ * @return -1 in case of error
+ * 			0 in case of success
+ */
+
+int processBinary( Request* req, Response* res );
+
+/**
+ * encode an attribute: [prop][attr][state][type][value]
+ * @param p - destination, must have room for 4 + 1 + 64 bytes
+ * @return encoded length
+ */
+
+unsigned encodeBinaryAttribute( uint8_t* p, uint8_t propIdx, uint8_t attrIdx, rawAttribute* a );
+
+/**
+ * encode a STREAM sample: [prop][attr][state][type][value][timestamp]
+ * @param p - destination, must have room for 4 + 1 + 64 + 4 bytes
+ * @return encoded length
+ */
+
+unsigned encodeBinarySample( uint8_t* p, uint8_t propIdx, rawAttribute* a, uint32_t timestamp );
+
+#endif
@@ -0,0 +1,188 @@
+/**
+ * @file coroutine.cpp
+ * @desc Usis coroutine handlers (C++20, desktop & RP2040)
+ *
+ * @author Etienne Cochard ecochard@r-libre.fr
+ * @version 1.0
+ **/
+
+#include "coroutine.h"
+
+#ifdef USIS_COROUTINES
+
+/**
+ * frames pool, each frame has its wait slot
+ */
+
+alignas( max_align_t ) static uint8_t pool[COROUTINE_POOL_SIZE][COROUTINE_FRAME_SIZE];
+static bool used[COROUTINE_POOL_SIZE];
+
+struct CoroSlot
+{
+	std::coroutine_handle<> handle; // NULL if not suspended
+	CoroWait* wait; // awaiter, kept in the frame while suspended
+	rawValue* owner; // value given to the handler (NULL for commands)
+};
+
+static CoroSlot slots[COROUTINE_POOL_SIZE];
+static rawValue* owner; // owner of the next frame
+
+/**
+ * frames allocation, NULL when the pool is empty or the frame too big
+ */
+
+void* __coroAlloc( size_t size ) {
+	if( size > COROUTINE_FRAME_SIZE ) {
+		return NULL;
+	}
+
+	for( unsigned i = 0; i < COROUTINE_POOL_SIZE; i++ ) {
+		if( !used[i] ) {
+			used[i] = true;
+			slots[i].owner = owner;
+			return pool[i];
+		}
+	}
+
+	return NULL;
+}
+
+void __coroFree( void* frame ) {
+	unsigned i = ( (uint8_t*)frame - &pool[0][0] ) / COROUTINE_FRAME_SIZE;
+	used[i] = false;
+	slots[i].handle = nullptr;
+	slots[i].owner = NULL;
+}
+
+/**
+ * messages starting a coroutine, keep the owner of its frame
+ */
+
+bool __coroOwner( PropertyMsg msg, rawValue* value ) {
+	if( msg != MsgSet && msg != MsgCmd ) {
+		return false;
+	}
+
+	owner = value;
+	return true;
+}
+
+bool coroutineAvailable( ) {
+	for( unsigned i = 0; i < COROUTINE_POOL_SIZE; i++ ) {
+		if( !used[i] ) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/**
+ * start a coroutine handler
+ */
+
+void __startCoroutine( Coroutine co, Response* res ) {
+	if( !co.started && !res->isDone( ) ) {
+		res->sendError( "M14", "NO TASK SLOT" );
+	}
+}
+
+/**
+ * destroy the suspended coroutines of a property
+ */
+
+void cancelCoroutines( rawProperty* prop ) {
+	rawValue* value = prop ? &prop->attrs->value : NULL;
+	bool found = false;
+
+	for( unsigned i = 0; i < COROUTINE_POOL_SIZE; i++ ) {
+		CoroSlot* s = &slots[i];
+		if( !s->handle || ( prop && s->owner != value ) ) {
+			continue;
+		}
+
+		// frame is released by destroy
+		std::coroutine_handle<> h = s->handle;
+		s->handle = nullptr;
+		h.destroy( );
+		found = true;
+	}
+
+	if( found && prop && ( prop->attrs->value.attrs & PROPERTY_STATE_MASK ) == PROPERTY_STATE_BUSY ) {
+		setPropertyState( prop, PROPERTY_STATE_READY );
+	}
+}
+
+/**
+ * check if the waited condition is met
+ */
+
+bool CoroWait::done( ) const {
+	switch( kind ) {
+		case CoroPin: {
+			return digitalRead( pin ) == (PinStatus)value;
+		}
+
+		case CoroState: {
+			return ( prop->attrs->value.attrs & PROPERTY_STATE_MASK ) == value;
+		}
+
+		case CoroChange: {
+			return prop->attrs->rev != rev;
+		}
+	}
+
+	return false;
+}
+
+/**
+ * park the coroutine in the slot of its frame
+ */
+
+void CoroWait::await_suspend( std::coroutine_handle<> h ) {
+	unsigned i = ( (uint8_t*)h.address( ) - &pool[0][0] ) / COROUTINE_FRAME_SIZE;
+
+	deadline = millis( ) + timeout;
+	slots[i].wait = this;
+	slots[i].handle = h;
+}
+
+/**
+ * resume the coroutines whose condition is met or timeout expired
+ */
+
+void runCoroutines( ) {
+	const long now = millis( );
+
+	for( unsigned i = 0; i < COROUTINE_POOL_SIZE; i++ ) {
+		CoroSlot* s = &slots[i];
+		if( !s->handle ) {
+			continue;
+		}
+
+		CoroWait* w = s->wait;
+		const bool elapsed = ( w->kind == CoroDelay || w->timeout ) && (long)( now - w->deadline ) >= 0;
+
+		if( w->kind == CoroDelay ) {
+			if( !elapsed ) {
+				continue;
+			}
+		}
+		else if( w->done( ) ) {
+			w->expired = false;
+		}
+		else if( elapsed ) {
+			w->expired = true;
+		}
+		else {
+			continue;
+		}
+
+		// frame may be released by resume
+		std::coroutine_handle<> h = s->handle;
+		s->handle = nullptr;
+		h.resume( );
+	}
+}
+
+#endif // USIS_COROUTINES
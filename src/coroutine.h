@@ -0,0 +1,195 @@
+/**
+ * @file coroutine.h
+ * @desc Usis coroutine handlers (C++20, desktop & RP2040)
+ *
+ * @author Etienne Cochard ecochard@r-libre.fr
+ * @version 1.0
+ **/
+
+#ifndef __USIS_COROUTINE_H
+#define __USIS_COROUTINE_H
+
+#include "properties.h"
+
+#if !defined( __AVR__ ) && defined( __cplusplus ) && __cplusplus >= 202002L && defined( __has_include )
+#	if __has_include( <coroutine> )
+#		define USIS_COROUTINES 1
+#	endif
+#endif
+
+#ifdef USIS_COROUTINES
+
+#include <coroutine>
+
+// coroutine frames are taken from a static pool
+#ifndef COROUTINE_POOL_SIZE
+#	define COROUTINE_POOL_SIZE 4
+#endif
+
+// max size of a coroutine frame (locals kept across co_await are in the frame)
+#ifndef COROUTINE_FRAME_SIZE
+#	define COROUTINE_FRAME_SIZE 256
+#endif
+
+void* __coroAlloc( size_t size );
+void __coroFree( void* frame );
+bool __coroOwner( PropertyMsg msg, rawValue* value );
+
+/**
+ * return type of a coroutine handler
+ * the coroutine runs until its first co_await, then it is resumed from the messages loop
+ * req & res are only valid until the first co_await (the response is sent by then)
+ * only MsgSet & MsgCmd start a coroutine, the other messages get the normal answer
+ * a SET is refused (M14) before the value is stored when no frame is available
+ * STOP on the property (or STOP;ALL) destroys its suspended coroutine, the property goes READY
+ *
+ * @example
+ * 	Coroutine moveHandler( PropertyMsg msg, Request* req, Response* res, rawValue* value ) {
+ * 		if( msg != MsgSet ) co_return;
+ * 		rawProperty* p = findProperty( "GRATING_ANGLE" );
+ * 		setPropertyState( p, PROPERTY_STATE_BUSY );
+ * 		startMotor( value->fval );
+ * 		co_await coWaitPin( PIN_END, HIGH, 30000 );
+ * 		co_await coDelay( 50 ); // settle
+ * 		setPropertyValue( p, readEncoder( ) );
+ * 		setPropertyState( p, PROPERTY_STATE_READY );
+ * 	}
+ *
+ * 	PROPERTY_START( "GRATING_ANGLE", PROPERTY_TYPE_FLOAT, 0.0f, COROUTINE_HANDLER( moveHandler ) )
+ */
+
+struct Coroutine
+{
+	struct promise_type
+	{
+		static void* operator new( size_t size ) noexcept {
+			return __coroAlloc( size );
+		}
+
+		static void operator delete( void* frame ) {
+			__coroFree( frame );
+		}
+
+		static Coroutine get_return_object_on_allocation_failure( ) {
+			return Coroutine{ false };
+		}
+
+		Coroutine get_return_object( ) {
+			return Coroutine{ true };
+		}
+
+		std::suspend_never initial_suspend( ) noexcept {
+			return {};
+		}
+
+		// the frame is released as soon as the coroutine ends
+		std::suspend_never final_suspend( ) noexcept {
+			return {};
+		}
+
+		void return_void( ) {
+		}
+
+		void unhandled_exception( ) {
+		}
+	};
+
+	bool started; // false if no frame was available
+};
+
+/**
+ * what a suspended coroutine is waiting for
+ */
+
+enum CoroWaitKind
+{
+	CoroDelay = 1,
+	CoroPin = 2,
+	CoroState = 3,
+	CoroChange = 4,
+};
+
+struct CoroWait
+{
+	uint8_t kind; // CoroWaitKind
+	uint8_t value; // pin level or property state
+	uint16_t pin; // CoroPin
+	rawProperty* prop; // CoroState & CoroChange
+	uint32_t rev; // CoroChange: revision when suspended
+	uint32_t timeout; // ms, 0 for none (CoroDelay: the delay)
+	long deadline; // set when suspended
+	bool expired; // resumed by the timeout
+
+	bool done( ) const;
+
+	bool await_ready( ) const {
+		return kind != CoroDelay && done( );
+	}
+
+	void await_suspend( std::coroutine_handle<> h );
+
+	// false if resumed by the timeout
+	bool await_resume( ) const {
+		return !expired;
+	}
+};
+
+/**
+ * awaitables
+ * co_await returns false when the timeout (ms, 0 for none) expired before the condition
+ */
+
+inline CoroWait coDelay( uint32_t ms ) {
+	return CoroWait{ CoroDelay, 0, 0, NULL, 0, ms, 0, false };
+}
+
+inline CoroWait coWaitPin( unsigned pin, PinStatus level, uint32_t timeout = 0 ) {
+	return CoroWait{ CoroPin, (uint8_t)level, (uint16_t)pin, NULL, 0, timeout, 0, false };
+}
+
+// property (VALUE attribute) has the given state
+inline CoroWait coWaitState( rawProperty* prop, uint8_t state, uint32_t timeout = 0 ) {
+	return CoroWait{ CoroState, state, 0, prop, 0, timeout, 0, false };
+}
+
+// property value or state changed
+inline CoroWait coWaitChange( rawProperty* prop, uint32_t timeout = 0 ) {
+	return CoroWait{ CoroChange, 0, 0, prop, prop->attrs->rev, timeout, 0, false };
+}
+
+/**
+ * start a coroutine handler from a pfnHandler, M14 is sent if no frame is available
+ */
+
+void __startCoroutine( Coroutine co, Response* res );
+
+// pfnHandler calling a coroutine handler on MsgSet & MsgCmd
+#define COROUTINE_HANDLER( coro ) \
+	CoroutineHandler( []( PropertyMsg msg, Request* req, Response* res, rawValue* value ) { \
+		if( __coroOwner( msg, value ) ) { \
+			__startCoroutine( coro( msg, req, res, value ), res ); \
+		} \
+	} )
+
+/**
+ * true if a coroutine can be started (a frame is free)
+ */
+
+bool coroutineAvailable( );
+
+/**
+ * destroy the suspended coroutines started for a property, NULL for all
+ * the property goes READY if it was BUSY
+ */
+
+void cancelCoroutines( rawProperty* prop );
+
+/**
+ * resume the coroutines ready to go on, called once per loop (cf. processIdle)
+ */
+
+void runCoroutines( );
+
+#endif // USIS_COROUTINES
+
+#endif
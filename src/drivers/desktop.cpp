@@ -6,7 +6,10 @@
 
 #include <ctime>
 #include <stdint.h>
+#include <string.h>
 #include <sys/time.h>
+#include <poll.h>
+#include <unistd.h>
 
 #include "desktop.h"
 
@@ -52,6 +55,34 @@ int main( ) {
 	return 0;
 }
 
+/**
+ * default implementation, byte per byte
+ */
+
+void Stream::write( const uint8_t* buffer, size_t length ) {
+	for( size_t i = 0; i < length; i++ ) {
+		write( buffer[i] );
+	}
+}
+
+/**
+ * default implementation, byte per byte
+ */
+
+size_t Stream::readBytes( char* buffer, size_t length ) {
+	size_t count = 0;
+	while( count < length ) {
+		int ch = read( );
+		if( ch < 0 ) {
+			break;
+		}
+
+		buffer[count++] = (char)ch;
+	}
+
+	return count;
+}
+
 /**
  * 
  */
@@ -60,6 +91,8 @@ SerialStream::SerialStream( ) {
 	in = stdin;
 	//in = fopen( "build-desktop/test.txt", "r" );
 	out = stdout;
+	pos = 0;
+	len = 0;
 }
 
 /**
@@ -77,12 +110,62 @@ void SerialStream::write(uint8_t ch)  {
 	putc( ch, out );
 }
 
+/**
+ * 
+ */
+
+void SerialStream::write( const uint8_t* buffer, size_t length ) {
+	fwrite( buffer, 1, length, out );
+}
+
 /**
  * 
  */
 
 int SerialStream::read() {
-	return getc( in ); 
+	if( !available( ) ) {
+		return -1;
+	}
+
+	return (uint8_t)line[pos++];
+}
+
+/**
+ * bytes already received, the input is polled without waiting
+ * the bytes are read as they come (no line buffering), so binary frames are seen as well
+ */
+
+int SerialStream::available() {
+	if( pos >= len ) {
+		pos = 0;
+		len = 0;
+
+		// nothing to do, time to send the answers
+		fflush( out );
+
+		struct pollfd pfd = { fileno( in ), POLLIN, 0 };
+		if( poll( &pfd, 1, 0 ) > 0 && ( pfd.revents & POLLIN ) ) {
+			ssize_t n = ::read( pfd.fd, line, sizeof( line ) );
+			len = n > 0 ? n : 0;
+		}
+	}
+
+	return len - pos;
+}
+
+/**
+ * 
+ */
+
+size_t SerialStream::readBytes( char* buffer, size_t length ) {
+	size_t count = available( );
+	if( count > length ) {
+		count = length;
+	}
+
+	memcpy( buffer, line + pos, count );
+	pos += count;
+	return count;
 }
 
 /**
@@ -3,6 +3,9 @@
 
 #include <stdio.h>
 #include <stdint.h>
+#include <stddef.h>
+
+#define count_of( x ) ( sizeof( x ) / sizeof( ( x )[0] ) )
 
 long millis( );
 long micros( );
@@ -16,18 +19,34 @@ class Stream {
 public:
 	virtual void write( uint8_t b ) = 0;
 	virtual int read( ) = 0;
+
+	// write a whole buffer in one call
+	virtual void write( const uint8_t* buffer, size_t length );
+
+	// count of bytes that can be read without blocking
+	virtual int available( ) = 0;
+
+	// read up to length bytes, return the count of bytes read
+	virtual size_t readBytes( char* buffer, size_t length );
 };
 
 class SerialStream : public Stream {
 	FILE* in;
 	FILE* out;
+
+	char line[256];		// pending input (received, not read yet)
+	unsigned pos;		// read position in line
+	unsigned len;		// bytes in line
 	
 public:
 	explicit SerialStream( );
 	void begin( int );
 
 	virtual void write(uint8_t ch) override;
+	virtual void write( const uint8_t* buffer, size_t length ) override;
 	virtual int read() override;
+	virtual int available() override;
+	virtual size_t readBytes( char* buffer, size_t length ) override;
 };
 
 extern SerialStream Serial;
@@ -51,6 +70,7 @@ enum PinStatus {
 
 void pinMode( unsigned ulPin, PinMode ulMode);
 void digitalWrite( unsigned ulPin, PinStatus ulVal);
+PinStatus digitalRead( unsigned ulPin );
 
 #define PIN_LED	0
 
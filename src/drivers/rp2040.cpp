@@ -1,6 +1,7 @@
 
 #include "rp2040.h"
 #include <hardware/timer.h>
+#include <pico/stdio_usb.h>
 #include <tusb.h>
 
 /**
@@ -36,6 +37,10 @@ uint64_t micros() {
 }
 
 // :: Serial implementation ::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::::
+//		all the reads & writes go through the tinyusb cdc fifos (stdio_usb only inits the usb stack)
+
+// max time to wait for room in the cdc fifo, the frame is dropped after (host not reading)
+#define SERIAL_WRITE_TIMEOUT_US 500000
 
 HardwareSerial::HardwareSerial() {
 }
@@ -45,11 +50,82 @@ void HardwareSerial::begin( int speed ) {
 }
 
 int HardwareSerial::read() {
-	return getchar_timeout_us( 1 );
+	return tud_cdc_available() ? tud_cdc_read_char() : -1;
 }
 
 void HardwareSerial::write( uint8_t ch ) {
-	putchar_raw( ch );
+	write( &ch, 1 );
+}
+
+/**
+ * whole frame in the cdc fifo, then flushed (one usb transfer when it fits)
+ * nothing is sent when no host is connected
+ */
+
+void HardwareSerial::write( const uint8_t* buffer, size_t length ) {
+	const uint64_t start = micros();
+
+	while( length && tud_cdc_connected() ) {
+		uint32_t count = tud_cdc_write( buffer, length );
+		buffer += count;
+		length -= count;
+
+		if( length ) {
+			// fifo full, let the usb stack send it
+			tud_cdc_write_flush();
+			tud_task();
+
+			if( micros() - start > SERIAL_WRITE_TIMEOUT_US ) {
+				break;
+			}
+		}
+	}
+
+	tud_cdc_write_flush();
+}
+
+/**
+ * @return count of bytes waiting in the usb cdc fifo
+ */
+
+int HardwareSerial::available() {
+	return tud_cdc_available();
+}
+
+/**
+ * read all we can from the cdc fifo in a single call
+ */
+
+size_t HardwareSerial::readBytes( char* buffer, size_t length ) {
+	return tud_cdc_read( buffer, length );
+}
+
+/**
+ * default implementation, byte per byte
+ */
+
+void Stream::write( const uint8_t* buffer, size_t length ) {
+	for( size_t i = 0; i < length; i++ ) {
+		write( buffer[i] );
+	}
+}
+
+/**
+ * default implementation, byte per byte
+ */
+
+size_t Stream::readBytes( char* buffer, size_t length ) {
+	size_t count = 0;
+	while( count < length ) {
+		int ch = read();
+		if( ch < 0 ) {
+			break;
+		}
+
+		buffer[count++] = (char)ch;
+	}
+
+	return count;
 }
 
 HardwareSerial Serial;
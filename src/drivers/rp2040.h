@@ -41,6 +41,15 @@ class Stream {
 public:
 	virtual void write( uint8_t b ) = 0;
 	virtual int read() = 0;
+
+	// write a whole buffer in one call
+	virtual void write( const uint8_t* buffer, size_t length );
+
+	// count of bytes that can be read without blocking
+	virtual int available() = 0;
+
+	// read up to length bytes, return the count of bytes read
+	virtual size_t readBytes( char* buffer, size_t length );
 };
 
 class HardwareSerial : public Stream {
@@ -49,7 +58,10 @@ public:
 
 	void begin( int speed );
 	void write( uint8_t b ) override;
+	void write( const uint8_t* buffer, size_t length ) override;
 	int read() override;
+	int available() override;
+	size_t readBytes( char* buffer, size_t length ) override;
 };
 
 extern HardwareSerial Serial;
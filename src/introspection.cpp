@@ -19,6 +19,12 @@
 	INFO;PROPERTY_ATTR_STATE;<prop_num>;<attr_num> return TEXT <attribute state>
 	INFO;PROPERTY_ATTR_ENUM_COUNT;<prop_num> return INT <Nb of possible values>
 	INFO;PROPERTY_ATTR_ENUM_VALUE;<prop_num>;<enum_num> return TEXT <value text>
+	INFO;PIPELINE_WINDOW return INT count of requests the host can send without waiting for responses
+	INFO;REVISION return INT current revision of the properties (cf. CHANGED)
+	INFO;SCHEMA_HASH return TEXT hash of the schema (8 hex digits), changes only when the property definitions change
+	INFO;DESCRIBE return the whole schema in one or more frames (commands are not listed):
+		M00;DESCRIBE;<index of the first property in the frame>;<MORE|OK>;PROP:ATTR:TYPE:MODE[:ENUM:ENUM...],...
+		PROP is empty when the attribute belongs to the same property as the previous item (even across frames)
 */
 
 
@@ -38,50 +44,6 @@ bool isCommand( rawProperty* p ) {
 	return type&PROPERTY_TYPE_CMD ? true : false;
 }
 
-/**
- * return the nth property
- */
-
-rawProperty* getPropertyByIndex( int idx, bool skipCmd ) {
-	rawProperty* p = properties;
-	int count = 0;
-
-	while( p ) {
-
-		if( !skipCmd || !isCommand(p) ) {
-			if( count == idx ) {
-				return p;
-			}
-
-			count++;
-		}
-
-		p = p->next;
-	}
-
-	return NULL;
-}
-
-/**
- * return the nth attribute
- */
-
-rawAttribute* getAttributeByIndex( rawProperty* p, int idx ) {
-	rawAttribute* a = p->attrs;
-	int count = 0;
-
-	while( a ) {
-		if( count == idx ) {
-			return a;
-		}
-
-		count++;
-		a = a->next;
-	}
-
-	return NULL;
-}
-
 /**
  * 
  */
@@ -155,6 +117,60 @@ cstr getAttrStateText( uint8_t attrs ) {
 	return "";
 }
 
+/**
+ * send the whole schema, properties are walked once
+ * cf. INFO;DESCRIBE
+ */
+
+static int processDescribe( Request*, Response* res ) {
+	int index = 0;
+	int first = 0;
+
+	for( rawProperty* p = properties; p; p = p->next ) {
+		if( isCommand( p ) ) {
+			continue;
+		}
+
+		cstr name = propName( p );
+
+		for( rawAttribute* a = p->attrs; a; a = a->next ) {
+			const uint8_t attrs = a->value.attrs;
+
+			char item[128];
+			unsigned il = formatItem( item, sizeof( item ), name, attrName( a ), getAttrTypeText( attrs ), getAttrModeText( attrs ) );
+
+			// enum values, as long as they fit (the others are available with PROPERTY_ATTR_ENUM_VALUE)
+			if( ( attrs & PROPERTY_TYPE_MASK ) == PROPERTY_TYPE_ENUM ) {
+				const int count = attrEnumCount( a );
+				for( int e = 0; e < count; e++ ) {
+					cstr v = attrEnumValue( a, e );
+					unsigned vl = strlen( v );
+					if( il + 1 + vl >= sizeof( item ) ) {
+						break;
+					}
+
+					item[il++] = ':';
+					memcpy( item + il, v, vl );
+					il += vl;
+				}
+
+				item[il] = 0;
+			}
+
+			if( appendItem( res, "DESCRIBE", Value( first ).toStr( ), item, il ) ) {
+				first = index;
+			}
+
+			name = "";
+		}
+
+		index++;
+	}
+
+	endItems( res, "DESCRIBE", Value( first ).toStr( ) );
+	return 0;
+}
+
 /**
  * 
  */
@@ -192,7 +208,7 @@ int processIntrospection( Request* req, Response* res ) {
 		if( getReqIntAttr( req, 0, &idx ) ) {
 			rawProperty* p = getPropertyByIndex( idx, true );
 			if( p ) {
-				res->send( prop, "", "OK", p->name );
+				res->send( prop, "", "OK", propName( p ) );
 				return 0;
 			}
 		}
@@ -248,15 +264,7 @@ int processIntrospection( Request* req, Response* res ) {
 		if( getReqIntAttr( req, 0, &idx ) ) {
 			rawProperty* p = getPropertyByIndex( idx, true );
 			if( p ) {
-				int count = 0;
-				rawAttribute* a = p->attrs;
-
-				while( a ) {
-					count++;
-					a = a->next;
-				}
-
-				res->send( prop, "", "OK", Value( count ).toStr() );
+				res->send( prop, "", "OK", Value( (int)p->count ).toStr() );
 				return 0;
 			}
 		}
@@ -278,7 +286,7 @@ int processIntrospection( Request* req, Response* res ) {
 			if( p ) {
 				rawAttribute* a = getAttributeByIndex( p, attrIdx );
 				if( a ) {
-					res->send( prop, "", "OK", a->name );
+					res->send( prop, "", "OK", attrName( a ) );
 					return 0;
 				}
 			}
@@ -324,7 +332,7 @@ int processIntrospection( Request* req, Response* res ) {
 			if( p ) {
 				rawAttribute* a = getAttributeByIndex( p, attrIdx );
 				if( a && ( a->value.attrs & PROPERTY_TYPE_MASK ) == PROPERTY_TYPE_ENUM ) {
-					res->send( prop, "", "OK", Value(a->value.ecount).toStr() );
+					res->send( prop, "", "OK", Value( (int)attrEnumCount( a ) ).toStr() );
 					return 0;
 				}
 			}
@@ -348,8 +356,8 @@ int processIntrospection( Request* req, Response* res ) {
 				int enumIdx = sid.toInt( );
 
 				rawAttribute* a = getAttributeByIndex( p, 0 );
-				if( a && ( a->value.attrs & PROPERTY_TYPE_MASK ) == PROPERTY_TYPE_ENUM && enumIdx>=0 && enumIdx<a->value.ecount ) {
-					res->send( prop, "VALUE", "OK", a->value.evals[enumIdx] );
+				if( a && ( a->value.attrs & PROPERTY_TYPE_MASK ) == PROPERTY_TYPE_ENUM && enumIdx>=0 && enumIdx<attrEnumCount( a ) ) {
+					res->send( prop, "VALUE", "OK", attrEnumValue( a, enumIdx ) );
 					return 0;
 				}
 			}
@@ -359,6 +367,51 @@ int processIntrospection( Request* req, Response* res ) {
 		return -1;
 	}
 
+	/**
+	 * PIPELINE WINDOW
+	 */
+
+	if( str_eq( prop, "PIPELINE_WINDOW" ) ) {
+		res->send( prop, "", "OK", Value( PROTOCOL_QUEUE_LEN ).toStr() );
+		return 0;
+	}
+
+	/**
+	 * SCHEMA HASH
+	 */
+
+	if( str_eq( prop, "SCHEMA_HASH" ) ) {
+		const uint32_t hash = getSchemaHash( );
+
+		char buffer[9];
+		for( int i = 0; i < 8; i++ ) {
+			buffer[i] = xtoa( ( hash >> ( 28 - i * 4 ) ) & 0x0f );
+		}
+
+		buffer[8] = 0;
+		res->send( prop, "", "OK", buffer );
+		return 0;
+	}
+
+	/**
+	 * DESCRIBE
+	 */
+
+	if( str_eq( prop, "DESCRIBE" ) ) {
+		return processDescribe( req, res );
+	}
+
+	/**
+	 * REVISION
+	 */
+
+	if( str_eq( prop, "REVISION" ) ) {
+		char rev[11];
+		u32_to_str( getRevision( ), rev );
+		res->send( prop, "", "OK", rev );
+		return 0;
+	}
+
 	res->sendError( "M01", "UNKNOWN PROPERTY" );
 	return -1;
 }
@@ -12,4 +12,16 @@
 #include "properties.h"
 int processIntrospection( Request* req, Response* res );
 
+/**
+ * check if property is a command
+ */
+
+bool isCommand( rawProperty* p );
+
+/**
+ * type name of an attribute: INT, FLOAT, ENUM, TEXT...
+ */
+
+cstr getAttrTypeText( uint8_t attrs );
+
 #endif
\ No newline at end of file
@@ -0,0 +1,223 @@
+/**
+ * @file profile.cpp
+ * @desc Usis request pipeline profiling
+ *
+ * @author Etienne Cochard ecochard@r-libre.fr
+ * @version 1.0
+ **/
+
+#include "profile.h"
+#include "properties.h"
+
+#ifdef USIS_PROFILE
+
+/**
+ * names of the rows (CMD_xxx order) & stages
+ */
+
+static const cstr rowNames[] = { "OTHER", "GET", "SET", "INFO", "MGET", "SUBSCRIBE", "UNSUBSCRIBE", "SYSTEM", "CHANGED", "WAIT", "STOP", "STREAM", "CALIB", "FACTORY_RESET", "BINARY" };
+static_assert( count_of( rowNames ) == PROFILE_ROWS, "rowNames must follow CommandId" );
+
+static const cstr stageNames[] = { "RECEIVE", "DISPATCH", "HANDLER", "RESPONSE", "TOTAL" };
+static_assert( count_of( stageNames ) == PROFILE_STAGES, "stageNames must follow ProfileStage" );
+
+static ProfileStat stats[PROFILE_ROWS][PROFILE_STAGES];
+
+/**
+ * request being measured
+ */
+
+static bool active = false;
+static uint8_t currentRow;
+static uint8_t currentStage;
+static uint8_t entered; // stages entered, one bit per stage
+static uint32_t received; // micros() of the last byte
+static uint32_t mark; // micros() of the last stage switch
+static uint32_t spent[PROFILE_STAGES];
+
+/**
+ * time since the last switch goes to the current stage
+ */
+
+static void charge( uint32_t now ) {
+	spent[currentStage] += now - mark;
+	mark = now;
+}
+
+/**
+ * add a duration to the statistics
+ */
+
+static void record( ProfileStat* s, uint32_t us ) {
+	if( !s->count || us < s->min ) {
+		s->min = us;
+	}
+
+	if( us > s->max ) {
+		s->max = us;
+	}
+
+	s->count++;
+	s->sum += us;
+
+	uint8_t bucket = 0;
+	while( us && bucket < PROFILE_BUCKETS - 1 ) {
+		us >>= 1;
+		bucket++;
+	}
+
+	if( s->buckets[bucket] != 0xFFFF ) {
+		s->buckets[bucket]++;
+	}
+}
+
+/**
+ *
+ */
+
+void profileBegin( uint8_t row, uint32_t when ) {
+	const uint32_t now = micros( );
+
+	memset( spent, 0, sizeof( spent ) );
+	spent[PROFILE_RECEIVE] = now - when;
+
+	currentRow = row < PROFILE_ROWS ? row : (uint8_t)CMD_OTHER;
+	currentStage = PROFILE_DISPATCH;
+	entered = ( 1 << PROFILE_RECEIVE ) | ( 1 << PROFILE_DISPATCH ) | ( 1 << PROFILE_TOTAL );
+	received = when;
+	mark = now;
+	active = true;
+}
+
+/**
+ *
+ */
+
+void profileEnd( ) {
+	if( !active ) {
+		return;
+	}
+
+	const uint32_t now = micros( );
+	charge( now );
+	spent[PROFILE_TOTAL] = now - received;
+	active = false;
+
+	for( uint8_t stage = 0; stage < PROFILE_STAGES; stage++ ) {
+		if( entered & ( 1 << stage ) ) {
+			record( &stats[currentRow][stage], spent[stage] );
+		}
+	}
+}
+
+/**
+ *
+ */
+
+uint8_t profileEnter( uint8_t stage ) {
+	const uint8_t previous = currentStage;
+
+	if( active ) {
+		charge( micros( ) );
+		currentStage = stage;
+		entered |= 1 << stage;
+	}
+
+	return previous;
+}
+
+void profileLeave( uint8_t previous ) {
+	if( active ) {
+		charge( micros( ) );
+		currentStage = previous;
+	}
+}
+
+/**
+ *
+ */
+
+const ProfileStat* getProfileStat( uint8_t row, uint8_t stage ) {
+	if( row >= PROFILE_ROWS || stage >= PROFILE_STAGES ) {
+		return NULL;
+	}
+
+	return &stats[row][stage];
+}
+
+void resetProfile( ) {
+	memset( stats, 0, sizeof( stats ) );
+}
+
+/**
+ * CMD:STAGE:COUNT:MIN:MAX:MEAN:B0/B1/...
+ */
+
+static unsigned formatStat( char* item, unsigned size, uint8_t row, uint8_t stage, const ProfileStat* s ) {
+	char* p = item;
+	char* end = item + size - 12; // room for a number & its separator
+
+	for( cstr n = rowNames[row]; *n; ) {
+		*p++ = *n++;
+	}
+
+	*p++ = ':';
+	for( cstr n = stageNames[stage]; *n; ) {
+		*p++ = *n++;
+	}
+
+	const uint32_t values[] = { s->count, s->min, s->max, (uint32_t)( s->sum / s->count ) };
+	for( unsigned i = 0; i < count_of( values ); i++ ) {
+		*p++ = ':';
+		p = u32_to_str( values[i], p );
+	}
+
+	int last = PROFILE_BUCKETS - 1;
+	while( last > 0 && !s->buckets[last] ) {
+		last--;
+	}
+
+	*p++ = ':';
+	for( int i = 0; i <= last && p < end; i++ ) {
+		if( i ) {
+			*p++ = '/';
+		}
+
+		p = u32_to_str( s->buckets[i], p );
+	}
+
+	*p = 0;
+	return p - item;
+}
+
+/**
+ *
+ */
+
+int processProfile( Request*, Response* res ) {
+	int index = 0;
+	int first = 0;
+
+	for( uint8_t row = 0; row < PROFILE_ROWS; row++ ) {
+		for( uint8_t stage = 0; stage < PROFILE_STAGES; stage++ ) {
+			const ProfileStat* s = &stats[row][stage];
+			if( !s->count ) {
+				continue;
+			}
+
+			char item[160];
+			unsigned il = formatStat( item, sizeof( item ), row, stage, s );
+
+			if( appendItem( res, "PROFILE", Value( first ).toStr( ), item, il ) ) {
+				first = index;
+			}
+
+			index++;
+		}
+	}
+
+	endItems( res, "PROFILE", Value( first ).toStr( ) );
+	return 0;
+}
+
+#endif
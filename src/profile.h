@@ -0,0 +1,130 @@
+/**
+ * @file profile.h
+ * @desc Usis request pipeline profiling
+ *
+ * @author Etienne Cochard ecochard@r-libre.fr
+ * @version 1.0
+ **/
+
+#ifndef __USIS_PROFILE_H
+#define __USIS_PROFILE_H
+
+#include "protocol.h"
+
+/**
+ * a request is measured from its last byte to the end of its answer,
+ * the time is split between the stages below, each stage only counts its own time
+ * (ie. a response sent by a handler is RESPONSE time, not HANDLER time)
+ *
+ * define USIS_PROFILE (in all units) to enable it, results are read with SYSTEM;PROFILE
+ * without it, the PROFILE_xxx macros are empty: nothing is measured nor stored
+ */
+
+enum ProfileStage
+{
+	PROFILE_RECEIVE = 0, // last byte to dispatch: parsing of the following bytes, requests queued before
+	PROFILE_DISPATCH, // request routing & property lookup
+	PROFILE_HANDLER, // application property handlers
+	PROFILE_RESPONSE, // response formatting & stream writes
+	PROFILE_TOTAL, // last byte to the end of the answer
+	PROFILE_STAGES,
+};
+
+#ifdef USIS_PROFILE
+
+// count of histogram buckets
+// bucket 0 counts the durations under 1 us, bucket n the ones in [2^(n-1), 2^n[ us, the last one all above
+#ifndef PROFILE_BUCKETS
+#	define PROFILE_BUCKETS 16
+#endif
+
+// rows of the statistics: one per well known command (CMD_OTHER for application commands) + binary frames
+#define PROFILE_ROWS ( CMD_COUNT + 1 )
+#define PROFILE_ROW_BINARY CMD_COUNT
+
+/**
+ * statistics of a stage for a command, times in us
+ */
+
+struct ProfileStat
+{
+	uint32_t count; // measured requests
+	uint32_t min;
+	uint32_t max;
+	uint64_t sum; // mean is sum / count
+	uint16_t buckets[PROFILE_BUCKETS]; // log2 histogram, counts are saturated
+};
+
+/**
+ * start measuring a request, the DISPATCH stage begins
+ * @param row - CMD_xxx or PROFILE_ROW_BINARY
+ * @param received - micros() when the last byte of the request was parsed
+ */
+
+void profileBegin( uint8_t row, uint32_t received );
+
+/**
+ * the request is answered, its stages are added to the statistics
+ */
+
+void profileEnd( );
+
+/**
+ * switch to another stage, return the stage left (to give back to profileLeave)
+ * does nothing outside of a request
+ */
+
+uint8_t profileEnter( uint8_t stage );
+void profileLeave( uint8_t previous );
+
+/**
+ * stage measured until the end of the scope
+ */
+
+class ProfileScope {
+	uint8_t m_previous;
+
+public:
+	explicit ProfileScope( uint8_t stage ) : m_previous( profileEnter( stage ) ) {
+	}
+
+	~ProfileScope( ) {
+		profileLeave( m_previous );
+	}
+};
+
+/**
+ * statistics of a stage for a command
+ */
+
+const ProfileStat* getProfileStat( uint8_t row, uint8_t stage );
+
+/**
+ * clear all statistics
+ */
+
+void resetProfile( );
+
+/**
+ * handle SYSTEM;PROFILE, statistics are sent in one or more frames:
+ * 	M00;PROFILE;<index of the first item>;<MORE|OK>;CMD:STAGE:COUNT:MIN:MAX:MEAN:B0/B1/...,...
+ * only the measured commands are sent, trailing empty buckets are not sent
+ */
+
+int processProfile( Request* req, Response* res );
+
+#	define PROFILE_STAMP( t ) ( t ) = (uint32_t)micros( )
+#	define PROFILE_BEGIN( row, received ) profileBegin( row, received )
+#	define PROFILE_END( ) profileEnd( )
+#	define PROFILE_SCOPE( stage ) ProfileScope __profileScope( stage )
+
+#else
+
+#	define PROFILE_STAMP( t )
+#	define PROFILE_BEGIN( row, received )
+#	define PROFILE_END( )
+#	define PROFILE_SCOPE( stage )
+
+#endif
+
+#endif
@@ -9,8 +9,50 @@
 #include <stdarg.h>
 #include "properties.h"
 #include "introspection.h"
+#include "binary.h"
+#include "scheduler.h"
+#include "coroutine.h"
+#include "storage.h"
+#include "profile.h"
+#include "trace.h"
 
 
+#if PROPERTY_HASH_SIZE
+
+/**
+ * properties hash table, buckets are chained by hnext
+ */
+
+static rawProperty* propertyHash[PROPERTY_HASH_SIZE];
+
+#else
+
+/**
+ * no hash table: properties are chained by hnext in lookup order,
+ * it starts as the definition order and follows the hits (cf. reorderProperties)
+ */
+
+static rawProperty* lookupList = NULL;
+static rawProperty* lookupLast = NULL;
+static unsigned lookups = 0; // since the last reorder
+
+#endif
+
+/**
+ * perfect hash given by PROPERTY_NAMES, count is 0 when not used
+ */
+
+static const uint16_t* phfDisp;
+static const cstr* phfNames;
+static rawProperty** phfSlots;
+static unsigned phfCount = 0;
+
+/**
+ * last property of the global properties
+ */
+
+static rawProperty* lastProperty = NULL;
+
 /**
  * add a property to the global properties
  */
@@ -23,40 +65,164 @@ void addProperty( rawProperty* p ) {
 		properties = p;
 	}
 	else {
-		rawProperty* pp = properties;
-		while( pp->next ) {
-			pp = pp->next;
-		}
+		lastProperty->next = p;
+	}
+
+	lastProperty = p;
+}
+
+/**
+ * if the property is listed in the perfect hash, give it its slot
+ */
+
+static void addPerfectHash( rawProperty* p ) {
+	if( !phfCount ) {
+		return;
+	}
+
+	const uint16_t hash = propHash( p );
+	unsigned slot = __phfSlot( hash, phfDisp[hash % phfCount], phfCount );
+	if( str_eq( phfNames[slot], propName( p ) ) ) {
+		phfSlots[slot] = p;
+	}
+}
+
+/**
+ * install the perfect hash built by PROPERTY_NAMES
+ * properties already registered are added
+ */
+
+bool __setPerfectHash( const uint16_t* disp, const cstr* names, rawProperty** slots, unsigned count ) {
+	phfDisp = disp;
+	phfNames = names;
+	phfSlots = slots;
+	phfCount = count;
+
+	for( rawProperty* p = properties; p; p = p->next ) {
+		addPerfectHash( p );
+	}
+
+	return true;
+}
+
+/**
+ * attributes table
+ */
+
+rawAttribute* attributes[PROPERTY_MAX_ATTRIBUTES];
+static unsigned attributeCount = 0;
+
+/**
+ * properties table (commands excepted), index is the handle
+ */
+
+static rawProperty* handles[PROPERTY_MAX_HANDLES];
+static unsigned handleCount = 0;
 
-		pp->next = p;
+/**
+ * intern a well known attribute name
+ */
+
+static uint8_t attrKey( uint16_t hash, cstr name ) {
+	cstr known;
+	uint8_t key;
+
+	switch( hash ) {
+		case str_hash_c( "VALUE" ): known = "VALUE"; key = ATTR_VALUE; break;
+		case str_hash_c( "MIN" ): known = "MIN"; key = ATTR_MIN; break;
+		case str_hash_c( "MAX" ): known = "MAX"; key = ATTR_MAX; break;
+		case str_hash_c( "UNIT" ): known = "UNIT"; key = ATTR_UNIT; break;
+		case str_hash_c( "PREC" ): known = "PREC"; key = ATTR_PREC; break;
+		default: return ATTR_OTHER;
 	}
+
+	return str_eq( name, known ) ? key : (uint8_t)ATTR_OTHER;
 }
 
 void addAttribute( rawProperty* p, rawAttribute* a ) {
 	
 	if( !p->attrs ) {
 		p->attrs = a;
+		p->first = attributeCount < PROPERTY_MAX_ATTRIBUTES ? attributeCount : PROPERTY_NO_INDEX;
+
+		// type is known with the first attribute
+		if( !isCommand( p ) && handleCount < PROPERTY_MAX_HANDLES ) {
+			handles[handleCount++] = p;
+		}
 	}
 	else {
-		rawAttribute* pa = p->attrs;
-		while( pa->next ) {
-			pa = pa->next;
+		rawAttribute* pa = &p->attrs[0];
+		if( p->first != PROPERTY_NO_INDEX ) {
+			pa = attributes[p->first + p->count - 1];
+		}
+		else {
+			while( pa->next ) {
+				pa = pa->next;
+			}
 		}
 
 		pa->next = a;
 	}
+
+	// attributes must follow each other in the table
+	if( p->first != PROPERTY_NO_INDEX ) {
+		if( p->first + p->count == attributeCount && attributeCount < PROPERTY_MAX_ATTRIBUTES ) {
+			attributes[attributeCount++] = a;
+		}
+		else {
+			p->first = PROPERTY_NO_INDEX;
+		}
+	}
+
+	const uint8_t key = attrKeyOf( a );
+	if( key != ATTR_OTHER && !p->known[key] ) {
+		p->known[key] = p->count + 1;
+	}
+
+	p->count++;
+}
+
+
+/**
+ * schema hash, definitions hashes are folded in registration order
+ */
+
+static uint32_t schemaHash = STR_HASH32_INIT;
+
+static void foldSchema( uint32_t h ) {
+	schemaHash = ( schemaHash ^ h ) * STR_HASH32_PRIME;
 }
 
+uint32_t getSchemaHash( ) {
+	return schemaHash;
+}
 
 /**
  * initialize the property
  */
 
-void __makeProperty( rawProperty* prop, cstr name, pfnHandler chg ) {
+void __makeProperty( rawProperty* prop, const rawPropertyDesc* desc, uint32_t schema ) {
+	memset( prop, 0, sizeof(*prop) );
 	addProperty( prop );
-	memset( prop, 0, sizeof(prop) );
-	prop->name = name;
-	prop->handler = chg;
+	prop->desc = desc;
+
+#if PROPERTY_HASH_SIZE
+	rawProperty** bucket = &propertyHash[propHash( prop ) & ( PROPERTY_HASH_SIZE - 1 )];
+	prop->hnext = *bucket;
+	*bucket = prop;
+#else
+	if( lookupLast ) {
+		lookupLast->hnext = prop;
+	}
+	else {
+		lookupList = prop;
+	}
+
+	lookupLast = prop;
+#endif
+
+	addPerfectHash( prop );
+	foldSchema( schema );
 }
 
 /**
@@ -65,17 +231,125 @@ void __makeProperty( rawProperty* prop, cstr name, pfnHandler chg ) {
 
 static const cstr __value = "VALUE";				
 
-void __addAttribute( rawProperty* prop, rawAttribute* pattr, cstr name, unsigned attr, const __uv& v, int ecount, cstr* enums, pfnHandler handler ) {
-	pattr->name = name ? name : __value;
-	pattr->id = 0;
-	pattr->value.attrs = attr;
-	pattr->value.fval = v.fval;	// sizeof(float) >= sizeof(char*) 
-	pattr->value.ecount = ecount;
-	pattr->value.evals = enums;
+void __addAttribute( rawProperty* prop, rawAttribute* pattr, const rawAttributeDesc* desc, uint32_t schema ) {
+	pattr->desc = desc;
+	pattr->value.attrs = flash_u8( desc->attrs );
+	flash_read( &pattr->value.sval, &desc->init, sizeof( desc->init ) );	// whole union, sizeof(char*) may be > sizeof(float)
 	pattr->next = NULL;
-	pattr->handler = handler;
+	pattr->subs = 0;
+	pattr->dirty = 0;
+	pattr->rev = 1;
 
 	addAttribute( prop, pattr );
+
+	// VALUE is part of the property definition
+	if( schema ) {
+		foldSchema( schema );
+	}
+}
+
+/**
+ * revision of the last change, attributes start at 1 so CHANGED;0 returns all of them
+ */
+
+static uint32_t revision = 1;
+
+/**
+ * sessions having events to send (one bit per session)
+ */
+
+static uint8_t pendingEvents = 0;
+
+/**
+ * properties having a history
+ */
+
+static rawHistory* histories = NULL;
+
+static void recordHistory( rawHistory* h, long now ) {
+	historySample* s = &h->samples[h->count % h->size];
+	s->time = (uint32_t)now;
+	memcpy( &s->ival, &h->prop->attrs->value.ival, sizeof( s->ival ) );
+	h->count++;
+}
+
+/**
+ * add a history to the property
+ */
+
+void __addHistory( rawProperty* prop, rawHistory* h, historySample* samples, uint16_t size, uint32_t period ) {
+	if( !prop->attrs || ( prop->attrs->value.attrs & PROPERTY_TYPE_MASK ) == PROPERTY_TYPE_CSTR || !size ) {
+		return;
+	}
+
+	h->prop = prop;
+	h->samples = samples;
+	h->size = size;
+	h->count = 0;
+	h->period = period;
+	h->next = histories;
+	h->nextTime = 0;
+	histories = h;
+
+	recordHistory( h, millis( ) );
+}
+
+/**
+ * sample the histories having a period
+ */
+
+static void sampleHistories( ) {
+	if( !histories ) {
+		return;
+	}
+
+	const long now = millis( );
+	for( rawHistory* h = histories; h; h = h->next ) {
+		if( !h->period || (long)( now - h->nextTime ) < 0 ) {
+			continue;
+		}
+
+		recordHistory( h, now );
+
+		h->nextTime += h->period;
+		if( (long)( now - h->nextTime ) >= 0 ) {
+			h->nextTime = now + h->period;
+		}
+	}
+}
+
+/**
+ * if the attribute value or state changed, flag it for subscribed sessions
+ */
+
+static void notifyChange( rawAttribute* a, const rawValue& old ) {
+	if( old.attrs == a->value.attrs && !memcmp( &old.sval, &a->value.sval, sizeof( a->value.sval ) ) ) {
+		return;
+	}
+
+	// histories recorded on change (value only)
+	if( histories && memcmp( &old.sval, &a->value.sval, sizeof( a->value.sval ) ) ) {
+		for( rawHistory* h = histories; h; h = h->next ) {
+			if( !h->period && h->prop->attrs == a ) {
+				recordHistory( h, millis( ) );
+			}
+		}
+	}
+
+	a->rev = ++revision;
+
+	if( a->subs ) {
+		a->dirty |= a->subs;
+		pendingEvents |= a->subs;
+	}
+}
+
+/**
+ * current revision
+ */
+
+uint32_t getRevision( ) {
+	return revision;
 }
 
 
@@ -139,11 +413,27 @@ int set_variant( rawValue* var, int v ) {
 	return 0;
 }
 
+/**
+ * attributes are scanned, values are inside their attribute
+ */
+
+const rawAttributeDesc* valueDesc( const rawValue* var ) {
+	for( rawProperty* p = properties; p; p = p->next ) {
+		for( rawAttribute* a = p->attrs; a; a = a->next ) {
+			if( &a->value == var ) {
+				return a->desc;
+			}
+		}
+	}
+
+	return NULL;
+}
+
 /**
  *
  */
 
-int set_variant( rawValue* var, cstr v ) {
+int set_variant( rawValue* var, cstr v, const rawAttributeDesc* desc ) {
 	// check !readonly
 	if( var->attrs & PROPERTY_FLAG_READONLY ) {
 		return -1;
@@ -152,8 +442,29 @@ int set_variant( rawValue* var, cstr v ) {
 	const uint8_t type = var->attrs & PROPERTY_TYPE_MASK;
 
 	if( type== PROPERTY_TYPE_ENUM ) {
-		for( int i=0; i<var->ecount; i++ ) {
-			cstr p = var->evals[i];
+		if( !desc ) {
+			desc = valueDesc( var );
+		}
+
+		if( !desc ) {
+			return -2;
+		}
+
+		const uint8_t ecount = flash_u8( desc->ecount );
+		const cstr* evals = (const cstr*)flash_ptr( desc->evals );
+
+		if( *v == PROPERTY_HANDLE_PREFIX ) {
+			int i = getHandleIndex( v );
+			if( i < 0 || i >= ecount ) {
+				return -3;
+			}
+
+			var->ival = i;
+			return 0;
+		}
+
+		for( int i=0; i<ecount; i++ ) {
+			cstr p = (cstr)flash_ptr( evals[i] );
 			if( str_eq(p,v) ) {
 				var->ival = i;
 				return 0;
@@ -192,7 +503,7 @@ int set_variant( rawValue* var, cstr v ) {
 
 void set_variant_state( rawValue* var, uint8_t state ) {
 	var->attrs &= ~PROPERTY_STATE_MASK;
-	var->attrs |= state & ~PROPERTY_STATE_MASK;
+	var->attrs |= state & PROPERTY_STATE_MASK;
 }
 
 /**
@@ -205,18 +516,102 @@ void set_variant_state( rawValue* var, uint8_t state ) {
  */
 
 rawProperty* findProperty( cstr name ) {
+	return findProperty( name, str_hash( name ) );
+}
+
+/**
+ * search for a property, hash already computed
+ */
+
+rawProperty* findProperty( cstr name, uint16_t hash ) {
+
+	if( *name == PROPERTY_HANDLE_PREFIX ) {
+		return getPropertyByIndex( getHandleIndex( name ), true );
+	}
+
+	if( phfCount ) {
+		rawProperty* p = phfSlots[__phfSlot( hash, phfDisp[hash % phfCount], phfCount )];
+		if( p && propHash( p ) == hash && str_eq( propName( p ), name ) ) {
+			return p;
+		}
+	}
+
+#if PROPERTY_HASH_SIZE
+	rawProperty* p = propertyHash[hash & ( PROPERTY_HASH_SIZE - 1 )];
+#else
+	rawProperty* p = lookupList;
+	lookups++;
+#endif
 
-	rawProperty* p = properties;
 	while( p ) {
-		if( str_eq( p->name, name ) ) {
+		if( propHash( p ) == hash && str_eq( propName( p ), name ) ) {
+#if PROPERTY_HASH_SIZE == 0
+			if( p->hits != 0xFF ) {
+				p->hits++;
+			}
+#endif
 			return p;
 		}
-		p = p->next;
+		p = p->hnext;
 	}
 
 	return NULL;
 }
 
+/**
+ * stable insertion sort of the lookup list by hits, the list is mostly sorted
+ * so properties are usually appended to the tail
+ * hits are then halved: the order follows the recent traffic
+ */
+
+void reorderProperties( ) {
+#if PROPERTY_HASH_SIZE == 0 && PROPERTY_REORDER_PERIOD
+	if( lookups < PROPERTY_REORDER_PERIOD ) {
+		return;
+	}
+
+	lookups = 0;
+
+	rawProperty* sorted = NULL;
+	rawProperty* last = NULL;
+	rawProperty* p = lookupList;
+
+	while( p ) {
+		rawProperty* next = p->hnext;
+
+		if( !last || last->hits >= p->hits ) {
+			p->hnext = NULL;
+			if( last ) {
+				last->hnext = p;
+			}
+			else {
+				sorted = p;
+			}
+
+			last = p;
+		}
+		else {
+			rawProperty** pp = &sorted;
+			while( ( *pp )->hits >= p->hits ) {
+				pp = &( *pp )->hnext;
+			}
+
+			p->hnext = *pp;
+			*pp = p;
+		}
+
+		p = next;
+	}
+
+	lookupList = sorted;
+	lookupLast = last;
+
+	for( p = lookupList; p; p = p->hnext ) {
+		p->hits >>= 1;
+	}
+#endif
+}
+
 /**
  * search for an attribute in the property
  * @param prop - the property inside which we look
@@ -227,11 +622,28 @@ rawProperty* findProperty( cstr name ) {
  * 	rawPropertyAttr* attr = findAttr( prop, "MIN" );
  */
 
-rawAttribute* findAttr( rawProperty* prop, cstr attrName ) {
+rawAttribute* findAttr( rawProperty* prop, cstr name ) {
+	return findAttr( prop, name, str_hash( name ) );
+}
+
+/**
+ * search for an attribute, hash already computed
+ */
+
+rawAttribute* findAttr( rawProperty* prop, cstr name, uint16_t hash ) {
+
+	if( *name == PROPERTY_HANDLE_PREFIX ) {
+		return getAttributeByIndex( prop, getHandleIndex( name ) );
+	}
+
+	uint8_t key = attrKey( hash, name );
+	if( key != ATTR_OTHER ) {
+		return getAttr( prop, key );
+	}
 
 	rawAttribute* pa = prop->attrs;
 	while( pa ) {
-		if( str_eq(pa->name,attrName) ) {
+		if( str_eq( attrName( pa ), name ) ) {
 			return pa;
 		}
 
@@ -241,6 +653,104 @@ rawAttribute* findAttr( rawProperty* prop, cstr attrName ) {
 	return NULL;
 }
 
+/**
+ * well known attribute of a property
+ */
+
+rawAttribute* getAttr( rawProperty* prop, uint8_t key ) {
+	if( key >= ATTR_KNOWN_COUNT || !prop->known[key] ) {
+		return NULL;
+	}
+
+	return getAttributeByIndex( prop, prop->known[key] - 1 );
+}
+
+/**
+ * return the nth attribute
+ */
+
+rawAttribute* getAttributeByIndex( rawProperty* p, int idx ) {
+	if( idx < 0 || idx >= p->count ) {
+		return NULL;
+	}
+
+	if( p->first != PROPERTY_NO_INDEX ) {
+		return attributes[p->first + idx];
+	}
+
+	rawAttribute* a = p->attrs;
+	while( idx-- ) {
+		a = a->next;
+	}
+
+	return a;
+}
+
+/**
+ * return the nth property
+ * without commands, the handles table is used, else (or beyond the table) the last match is kept
+ * so that enumerating by increasing index does not restart from the head
+ * (properties are only appended, a cached position stays valid)
+ */
+
+rawProperty* getPropertyByIndex( int idx, bool skipCmd ) {
+	static rawProperty* lastProp = NULL;
+	static int lastIdx = 0;
+	static bool lastSkip = false;
+
+	if( idx < 0 ) {
+		return NULL;
+	}
+
+	if( skipCmd ) {
+		if( idx < (int)handleCount ) {
+			return handles[idx];
+		}
+
+		if( handleCount < PROPERTY_MAX_HANDLES ) {
+			return NULL;
+		}
+	}
+
+	rawProperty* p = properties;
+	int count = 0;
+
+	if( lastProp && lastSkip == skipCmd && lastIdx <= idx ) {
+		p = lastProp;
+		count = lastIdx;
+	}
+
+	while( p ) {
+
+		if( !skipCmd || !isCommand(p) ) {
+			if( count == idx ) {
+				lastProp = p;
+				lastIdx = idx;
+				lastSkip = skipCmd;
+				return p;
+			}
+
+			count++;
+		}
+
+		p = p->next;
+	}
+
+	return NULL;
+}
+
+/**
+ * index given by a handle (#<index>)
+ */
+
+int getHandleIndex( cstr name ) {
+	if( !name || *name != PROPERTY_HANDLE_PREFIX || !isValidNumber( name + 1, false ) || name[1] == '-' ) {
+		return -1;
+	}
+
+	return str_to_i( name + 1 );
+}
+
 /**
  * change an attribute value (float version)
  * @param attr - attribute we want to change
@@ -251,7 +761,10 @@ rawAttribute* findAttr( rawProperty* prop, cstr attrName ) {
  */
 
 int setAttr( rawAttribute* a, float v ) {
-	return set_variant( &a->value, v );
+	rawValue old = a->value;
+	int rc = set_variant( &a->value, v );
+	notifyChange( a, old );
+	return rc;
 }
 
 /**
@@ -264,7 +777,10 @@ int setAttr( rawAttribute* a, float v ) {
  */
 
 int setAttr( rawAttribute* a, int v ) {
-	return set_variant( &a->value, v );
+	rawValue old = a->value;
+	int rc = set_variant( &a->value, v );
+	notifyChange( a, old );
+	return rc;
 }
 
 /**
@@ -277,17 +793,87 @@ int setAttr( rawAttribute* a, int v ) {
  */
 
 int setAttr( rawAttribute* a, cstr v ) {
-	return set_variant( &a->value, v );
+	rawValue old = a->value;
+	int rc = set_variant( &a->value, v, a->desc );
+	notifyChange( a, old );
+	return rc;
 }
 
 /**
- * change the attribute state
- * @param attr attribute to change
- * @param state new state
+ * change a TEXT attribute with a value received from the host
  */
 
-void setAttrState( rawAttribute* a, uint8_t state ) {
-	set_variant_state( &a->value, state );
+int setAttrText( rawAttribute* a, cstr v ) {
+	char* text = (char*)flash_ptr( a->desc->text );
+	if( !text ) {
+		return setAttr( a, v );
+	}
+
+	const unsigned len = strlen( v );
+	if( len > PROPERTY_TEXT_LEN ) {
+		return -3;
+	}
+
+	// the current value stays valid until replaced (events, notifyChange)
+	char* next = a->value.sval == text ? text + PROPERTY_TEXT_LEN + 1 : text;
+	memcpy( next, v, len + 1 );
+	return setAttr( a, next );
+}
+
+/**
+ * change the attribute state
+ * @param attr attribute to change
+ * @param state new state
+ */
+
+void setAttrState( rawAttribute* a, uint8_t state ) {
+	rawValue old = a->value;
+	set_variant_state( &a->value, state );
+	notifyChange( a, old );
+}
+
+/**
+ * change an attribute value, readonly flag ignored
+ * @param attr attribute to change
+ * @param v new value
+ */
+
+void forceAttr( rawAttribute* a, float v ) {
+	rawValue old = a->value;
+	if( ( a->value.attrs & PROPERTY_TYPE_MASK ) == PROPERTY_TYPE_FLOAT ) {
+		a->value.fval = v;
+	}
+	else {
+		a->value.ival = (int)v;
+	}
+
+	notifyChange( a, old );
+}
+
+void forceAttr( rawAttribute* a, int v ) {
+	rawValue old = a->value;
+	const uint8_t type = a->value.attrs & PROPERTY_TYPE_MASK;
+
+	if( type == PROPERTY_TYPE_FLOAT ) {
+		a->value.fval = (float)v;
+	}
+	else if( type != PROPERTY_TYPE_ENUM || ( v >= 0 && v < attrEnumCount( a ) ) ) {
+		a->value.ival = v;
+	}
+
+	notifyChange( a, old );
+}
+
+/**
+ * restore the attribute definition
+ * @param attr attribute to reset
+ */
+
+void resetAttr( rawAttribute* a ) {
+	rawValue old = a->value;
+	a->value.attrs = flash_u8( a->desc->attrs );
+	flash_read( &a->value.sval, &a->desc->init, sizeof( a->desc->init ) );
+	notifyChange( a, old );
 }
 
 /**
@@ -346,6 +932,52 @@ void setPropertyState( rawProperty* prop, uint8_t state ) {
 	setAttrState( &prop->attrs[0], state );
 }
 
+/**
+ * change the property attribute value (float version)
+ * @return 0 if ok
+ * 			-1 if readonly
+ * 			-2 if bad type
+ * 			-3 if unknown attribute
+ */
+
+int setPropertyValue( rawProperty* prop, cstr attrName, float v ) {
+	rawAttribute* a = findAttr( prop, attrName );
+	return a ? setAttr( a, v ) : -3;
+}
+
+/**
+ * change the property attribute value (int version)
+ */
+
+int setPropertyValue( rawProperty* prop, cstr attrName, int v ) {
+	rawAttribute* a = findAttr( prop, attrName );
+	return a ? setAttr( a, v ) : -3;
+}
+
+/**
+ * change the property attribute value (char* version)
+ */
+
+int setPropertyValue( rawProperty* prop, cstr attrName, cstr v ) {
+	rawAttribute* a = findAttr( prop, attrName );
+	return a ? setAttr( a, v ) : -3;
+}
+
+/**
+ * change the property attribute state
+ * @return false if unknown attribute
+ */
+
+bool setPropertyState( rawProperty* prop, cstr attrName, uint8_t state ) {
+	rawAttribute* a = findAttr( prop, attrName );
+	if( !a ) {
+		return false;
+	}
+
+	setAttrState( a, state );
+	return true;
+}
+
 /**
  * 	compute property state string
  */
@@ -373,7 +1005,9 @@ cstr calcPropState( uint8_t state ) {
  * convert the given value to string
  */
 
-cstr valueToStr( rawValue* var, char* buffer ) {
+cstr valueToStr( rawAttribute* a, char* buffer ) {
+
+	rawValue* var = &a->value;
 
 	*buffer = 0;
 	switch( var->attrs & PROPERTY_TYPE_MASK ) {
@@ -389,7 +1023,7 @@ cstr valueToStr( rawValue* var, char* buffer ) {
 
 		case PROPERTY_TYPE_ENUM: {
 			//todo: check range.
-			return var->evals[var->ival];
+			return attrEnumValue( a, var->ival );
 		}
 
 		case PROPERTY_TYPE_CSTR: {
@@ -400,6 +1034,229 @@ cstr valueToStr( rawValue* var, char* buffer ) {
 	return buffer;
 }
 
+/**
+ * send pending events to the session
+ */
+
+static void processPropertyEvents( ProtocolSession* session ) {
+
+	uint8_t mask = session->getMask( );
+	if( !( pendingEvents & mask ) ) {
+		return;
+	}
+
+	pendingEvents &= ~mask;
+
+	const bool binary = session->isBinary( );
+	Response res( session->getStream( ), true, binary );
+	char buffer[32];
+	uint8_t payload[1 + 4 + 1 + 64];
+	uint8_t propIdx = 0;
+
+	for( rawProperty* p = properties; p; p = p->next ) {
+		uint8_t attrIdx = 0;
+
+		for( rawAttribute* a = p->attrs; a; a = a->next, attrIdx++ ) {
+			if( !( a->dirty & mask ) ) {
+				continue;
+			}
+
+			a->dirty &= ~mask;
+
+			if( binary ) {
+				payload[0] = BINARY_STATUS_EVENT;
+				res.sendBinary( payload, 1 + encodeBinaryAttribute( payload + 1, propIdx, attrIdx, a ) );
+			}
+			else {
+				res.sendEvent( propName( p ), attrName( a ), calcPropState( a->value.attrs ), valueToStr( a, buffer ) );
+			}
+		}
+
+		// binary indexes are the introspection ones
+		if( !isCommand( p ) ) {
+			propIdx++;
+		}
+	}
+}
+
+/**
+ * pending WAIT, one per session (cf. ProtocolSession::getMask)
+ */
+
+struct WaitSlot
+{
+	rawProperty* prop; // property we are waiting for, NULL if none
+	uint8_t state; // the answer is sent when the property leaves this state
+	long deadline; // millis() of the timeout
+};
+
+static WaitSlot waits[PROTOCOL_MAX_EVENT_SESSIONS];
+
+static WaitSlot* getWaitSlot( uint8_t mask ) {
+	uint8_t i = 0;
+	while( mask > 1 ) {
+		mask >>= 1;
+		i++;
+	}
+
+	return &waits[i];
+}
+
+/**
+ * send the pending WAIT answer when the state changed or on timeout
+ */
+
+static void sendPendingWait( ProtocolSession* session ) {
+
+	uint8_t mask = session->getMask( );
+	if( !mask ) {
+		return;
+	}
+
+	WaitSlot* w = getWaitSlot( mask );
+	if( !w->prop ) {
+		return;
+	}
+
+	rawAttribute* a = w->prop->attrs;
+	if( ( a->value.attrs & PROPERTY_STATE_MASK ) == w->state && (long)( millis( ) - w->deadline ) < 0 ) {
+		return;
+	}
+
+	char buffer[32];
+	Response res( session->getStream( ), true, session->isBinary( ) );
+	res.send( "WAIT", propName( w->prop ), calcPropState( a->value.attrs ), valueToStr( a, buffer ) );
+
+	w->prop = NULL;
+}
+
+/**
+ * streamed properties (cf. STREAM)
+ */
+
+struct StreamSlot
+{
+	rawProperty* prop; // streamed property, NULL if the slot is free
+	uint8_t mask; // session receiving the samples
+	uint8_t index; // property index (binary samples)
+	uint8_t state; // state of the last sample, 0xFF if none sent
+	uint32_t period; // ms
+	long next; // millis() of the next sample
+	float last; // value of the last sample (INT, FLOAT & ENUM)
+};
+
+static StreamSlot streams[PROPERTY_MAX_STREAMS];
+
+/**
+ * numeric value of an attribute, used by the deadband
+ */
+
+static float numericValue( rawAttribute* a ) {
+	switch( a->value.attrs & PROPERTY_TYPE_MASK ) {
+		case PROPERTY_TYPE_FLOAT: {
+			return a->value.fval;
+		}
+
+		case PROPERTY_TYPE_INT:
+		case PROPERTY_TYPE_ENUM: {
+			return (float)a->value.ival;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * send the samples due for the session
+ * a sample is not sent when the state did not change and the value moved less than PREC
+ * (TEXT values are always sent)
+ */
+
+static void sendStreamSamples( ProtocolSession* session ) {
+
+	uint8_t mask = session->getMask( );
+	if( !mask ) {
+		return;
+	}
+
+	const long now = millis( );
+	Response res( session->getStream( ), true, session->isBinary( ) );
+
+	for( unsigned i = 0; i < PROPERTY_MAX_STREAMS; i++ ) {
+		StreamSlot* st = &streams[i];
+		if( !st->prop || st->mask != mask || (long)( now - st->next ) < 0 ) {
+			continue;
+		}
+
+		// late: no burst to catch up
+		st->next += st->period;
+		if( (long)( now - st->next ) >= 0 ) {
+			st->next = now + st->period;
+		}
+
+		rawAttribute* a = st->prop->attrs;
+		const uint8_t state = a->value.attrs & PROPERTY_STATE_MASK;
+		const uint8_t type = a->value.attrs & PROPERTY_TYPE_MASK;
+		const float v = numericValue( a );
+
+		if( state == st->state && type != PROPERTY_TYPE_CSTR ) {
+			rawAttribute* prec = getAttr( st->prop, ATTR_PREC );
+			float delta = v > st->last ? v - st->last : st->last - v;
+			if( delta == 0 || ( prec && delta < numericValue( prec ) ) ) {
+				continue;
+			}
+		}
+
+		st->state = state;
+		st->last = v;
+
+		if( session->isBinary( ) ) {
+			uint8_t payload[1 + 4 + 1 + 64 + 4];
+			payload[0] = BINARY_STATUS_SAMPLE;
+			res.sendBinary( payload, 1 + encodeBinarySample( payload + 1, st->index, a, (uint32_t)now ) );
+		}
+		else {
+			char buffer[32];
+			char time[11];
+			u32_to_str( (uint32_t)now, time );
+			res.sendSample( propName( st->prop ), time, calcPropState( a->value.attrs ), valueToStr( a, buffer ) );
+		}
+	}
+}
+
+/**
+ * session idle: pending WAIT, events, samples
+ */
+
+static void processSessionIdle( ProtocolSession* session ) {
+	sendPendingWait( session );
+	processPropertyEvents( session );
+	sendStreamSamples( session );
+}
+
+/**
+ * loop idle, once for all sessions: histories, lookup order, tasks & coroutines
+ */
+
+static void processLoopIdle( ) {
+	sampleHistories( );
+	reorderProperties( );
+	runTasks( );
+
+#ifdef USIS_COROUTINES
+	runCoroutines( );
+#endif
+}
+
+/**
+ * called once all properties are defined
+ */
+
+void __initProperties( ) {
+	setSessionIdleHandler( processSessionIdle );
+	setIdleHandler( processLoopIdle );
+}
+
 /**
  * check if the value is a valid number
  * @param v string 0 term
@@ -449,167 +1306,1004 @@ bool isValidNumber( cstr v, bool flt ) {
 
 
 /**
- * handle GET command
+ * name used in the response, requests using handles get their handle back
  */
 
-int processPropertyGet( Request* req, Response* res ) {
-	rawProperty* prop = findProperty( req->getProperty() );
-	if( !prop ) {
-		res->sendError( "M01", "UNKNOWN PROPERTY" );
-		return -1;
-	}
+static cstr replyName( cstr requested, cstr name ) {
+	return *requested == PROPERTY_HANDLE_PREFIX ? requested : name;
+}
 
-	rawAttribute* attr = findAttr( prop, req->getValueStr( 0 ) );
-	if( !attr ) {
-		res->sendError( "M02", "UNKNOWN ATTRIBUTE" );
-		return -1;
-	}
+/**
+ * send the attribute value in response to GET/SET
+ * when the property is given by its handle, enum values are also sent as handles
+ */
 
-	if( prop->handler && attr->id==0  ) {
-		prop->handler( MsgGet, req, res, &attr->value );
-	}
+static void sendAttribute( Request* req, Response* res, rawProperty* prop, rawAttribute* attr ) {
+	static char buffer[32];
+	cstr pname = req->getProperty( );
+	cstr value;
 
-	if( !res->isDone() ) {
-		static char buffer[32];
-		res->send( prop->name, attr->name, calcPropState( attr->value.attrs ), valueToStr( &attr->value, buffer ) );
-		return 1;
+	if( *pname == PROPERTY_HANDLE_PREFIX && ( attr->value.attrs & PROPERTY_TYPE_MASK ) == PROPERTY_TYPE_ENUM ) {
+		buffer[0] = PROPERTY_HANDLE_PREFIX;
+		i_to_str( attr->value.ival, buffer + 1 );
+		value = buffer;
+	}
+	else {
+		value = valueToStr( attr, buffer );
 	}
-	
-	return 0;
-}
-
 
+	res->send( replyName( pname, propName( prop ) ), replyName( req->getAttr( ), attrName( attr ) ), calcPropState( attr->value.attrs ), value );
+}
 
 /**
- * handle SET command
+ * handle GET;PROP;HISTORY[;START]
+ * the samples from START (index since startup, the oldest kept one if not given or too old)
+ * are sent in one or more frames:
+ * 	M00;HISTORY;<index of the first sample of the frame>;<MORE|OK>;TIME:VALUE,...
  */
 
-int processPropertySet( Request* req, Response* res ) {
+static int processPropertyHistory( Request* req, Response* res, rawProperty* prop ) {
 
-	// get property
-	rawProperty* prop = findProperty( req->getProperty() );
-	if( !prop ) {
-		res->sendError( "M01", "UNKNOWN PROPERTY" );
-		return -1;
+	rawHistory* h = histories;
+	while( h && h->prop != prop ) {
+		h = h->next;
 	}
 
-	// search given attribute
-	rawAttribute* attr = findAttr( prop, req->getValueStr( 0 ) );
-	if( !attr ) {
+	if( !h ) {
 		res->sendError( "M02", "UNKNOWN ATTRIBUTE" );
 		return -1;
 	}
 
-	// get value & convert to the correct type
-	int rc = -2;
-	cstr v = req->getValueStr( 1 );
-	if( !v || *v==0 ) {
-		res->sendError( "M05", "NO VALUE GIVEN" );
+	cstr start = req->getValueStr( 1 );
+	if( *start && ( !isValidNumber( start, false ) || *start == '-' ) ) {
+		res->sendError( "M08", "BAD VALUE" );
 		return -1;
 	}
 
-	switch( attr->value.attrs & PROPERTY_TYPE_MASK ) {
-		case PROPERTY_TYPE_INT: {
-			// check all chars are digits
-			if( !isValidNumber(v,false) ) {
-				break;
-			}
-			
-			rc = setAttr( attr, str_to_i(v) );
-			break;
-		}
-
-		case PROPERTY_TYPE_FLOAT: {
-			if( !isValidNumber(v,true) ) {
-				break;
-			}
-			
-			rc = setAttr( attr, str_to_f(v) );
-			break;
-		}
+	const uint32_t oldest = h->count > h->size ? h->count - h->size : 0;
+	uint32_t index = *start ? str_to_u32( start ) : 0;
+	if( index < oldest ) {
+		index = oldest;
+	}
 
-		case PROPERTY_TYPE_ENUM: {
-			rc = setAttr( attr, v );
-			break;
-		}
+	// values are formatted like the attribute ones
+	rawAttribute a = *prop->attrs;
+	uint32_t first = index;
 
-		case PROPERTY_TYPE_CSTR: {
-			rc = setAttr( attr, v );
-			break;
-		}
-	}
+	// indexes are 32 bits (int is 16 bits on AVR)
+	char tag[11];
+	u32_to_str( first, tag );
 
-	switch( rc ) {
-		case -1: {
-			res->sendError( "M03", "READONLY" );
-			return -1;
-		}
+	for( ; index < h->count; index++ ) {
+		const historySample* s = &h->samples[index % h->size];
+		memcpy( &a.value.ival, &s->ival, sizeof( s->ival ) );
 
-		case -2: {
-			res->sendError( "M04", "BAD VALUE TYPE" );
-			return -1;
-		}
+		// TIME:VALUE
+		char item[48];
+		char buffer[32];
+		char* p = u32_to_str( s->time, item );
+		*p++ = ':';
 
-		case -3: {
-			res->sendError( "M08", "BAD VALUE" );
-			return -1;
+		cstr v = valueToStr( &a, buffer );
+		while( *v && p < item + sizeof( item ) - 1 ) {
+			*p++ = *v++;
 		}
-	}
 
-	if( prop->handler && attr->id==0 ) {
-		prop->handler( MsgSet, req, res, &attr->value );
-	}
+		*p = 0;
+		unsigned il = p - item;
 
-	if( !res->isDone() ) {
-		static char buffer[32];
-		res->send( prop->name, attr->name, calcPropState( attr->value.attrs ), valueToStr( &attr->value, buffer ) );
-		return 1;
+		if( appendItem( res, "HISTORY", tag, item, il ) ) {
+			u32_to_str( index, tag );
+		}
 	}
 
+	endItems( res, "HISTORY", tag );
 	return 0;
 }
 
 /**
- * process message according to the properties defined in the application
- *
- * @return -1 in case of error
- * 			0 in case of success
- * 			1 in case of command not handled
+ * handle GET command
  */
 
-int processProperty( Request* req, Response* res ) {
-
-	if( req->is( "GET" ) ) {
-		return processPropertyGet( req, res );
-	}
-	else if( req->is( "SET" ) ) {
-		return processPropertySet( req, res );
-	}
-	else if( req->is( "INFO" ) ) {
-		return processIntrospection( req, res );
+int processPropertyGet( Request* req, Response* res ) {
+	rawProperty* prop = findProperty( req->getProperty( ), req->getPropertyHash( ) );
+	if( !prop ) {
+		res->sendError( "M01", "UNKNOWN PROPERTY" );
+		return -1;
+	}
+
+	if( str_eq_c( req->getAttr( ), "HISTORY" ) ) {
+		return processPropertyHistory( req, res, prop );
+	}
+
+	rawAttribute* attr = findAttr( prop, req->getAttr( ), req->getAttrHash( ) );
+	if( !attr ) {
+		res->sendError( "M02", "UNKNOWN ATTRIBUTE" );
+		return -1;
+	}
+
+	// conditional GET: GET;PROP;ATTR;REV
+	cstr since = req->getValueStr( 1 );
+	if( *since && !isValidNumber( since, false ) ) {
+		res->sendError( "M08", "BAD VALUE" );
+		return -1;
+	}
+
+	pfnHandler handler = propHandler( prop );
+	if( handler && attr == prop->attrs ) {
+		PROFILE_SCOPE( PROFILE_HANDLER );
+		handler( MsgGet, req, res, &attr->value );
+	}
+
+	if( !res->isDone() ) {
+		// a revision after the current one comes from before a restart: the attribute is sent
+		uint32_t rev = *since ? str_to_u32( since ) : 0;
+		if( rev && rev <= revision && attr->rev <= rev ) {
+			res->send( replyName( req->getProperty( ), propName( prop ) ), replyName( req->getAttr( ), attrName( attr ) ), "UNCHANGED", NULL );
+			return 1;
+		}
+
+		sendAttribute( req, res, prop, attr );
+		return 1;
+	}
+	
+	return 0;
+}
+
+
+
+/**
+ * items list sent in one or more frames:
+ * 	M00;<command>;<tag>;<MORE|OK>;PROP:ATTR:STATE:VALUE,...
+ */
+
+static char listItems[PROTOCOL_MAX_RESP_LEN];
+static unsigned listLen = 0;
+
+/**
+ * format an item, return its length
+ * separators in the value (TEXT) are escaped: '\\' is put before ':' ',' ';' and '\\'
+ */
+
+unsigned formatItem( char* item, unsigned size, cstr prop, cstr attr, cstr state, cstr value ) {
+	char* p = item;
+
+	cstr parts[4] = { prop, attr, state, value };
+	for( int i = 0; i < 4; i++ ) {
+		if( i ) {
+			*p++ = ':';
+		}
+
+		cstr s = parts[i];
+		while( *s && p < item + size - 1 ) {
+			const char ch = *s++;
+			if( i == 3 && ( ch == ':' || ch == PROTOCOL_LIST_SEPARATOR || ch == PROTOCOL_SEPARATOR || ch == '\\' ) ) {
+				if( p >= item + size - 2 ) {
+					break;
+				}
+
+				*p++ = '\\';
+			}
+
+			*p++ = ch;
+		}
+	}
+
+	*p = 0;
+	return p - item;
+}
+
+/**
+ * append an item to the list, when it does not fit the pending items are sent (MORE)
+ * @return true if a frame was sent
+ */
+
+bool appendItem( Response* res, cstr command, cstr tag, const char* item, unsigned il ) {
+	// frame overhead: "M00;" + command + ";" + tag + ";MORE;" + "*CK\n"
+	const unsigned maxLen = PROTOCOL_MAX_RESP_LEN - ( 4 + strlen( command ) + 1 + strlen( tag ) + 6 + 4 );
+	bool sent = false;
+
+	if( listLen && listLen + 1 + il > maxLen ) {
+		listItems[listLen] = 0;
+		res->send( command, tag, "MORE", listItems );
+
+		listLen = 0;
+		sent = true;
+	}
+
+	if( listLen ) {
+		listItems[listLen++] = PROTOCOL_LIST_SEPARATOR;
+	}
+
+	memcpy( listItems + listLen, item, il );
+	listLen += il;
+	return sent;
+}
+
+/**
+ * send the last frame of the list
+ */
+
+void endItems( Response* res, cstr command, cstr tag ) {
+	listItems[listLen] = 0;
+	res->send( command, tag, "OK", listItems );
+	listLen = 0;
+}
+
+/**
+ * handle MGET command
+ * MGET;PROP[:ATTR],PROP[:ATTR],...
+ * all values are sent in one or more frames:
+ * 	M00;MGET;<index of first item>;<MORE|OK>;PROP:ATTR:STATE:VALUE,...
+ * MORE means another frame follows, on error, STATE is the error code and VALUE is empty
+ * the property handler receives MsgGet for each VALUE item, with a GET request of the item,
+ * the MGET response is not given to it: a handler answering itself does not add a frame
+ */
+
+int processPropertyMGet( Request* req, Response* res ) {
+
+	int index = 0;
+	int first = 0;
+
+	cstr list = req->getProperty( );
+	if( *list == 0 ) {
+		res->sendError( "M05", "NO VALUE GIVEN" );
+		return -1;
+	}
+
+	while( *list ) {
+
+		// extract PROP[:ATTR]
+		char token[64];
+		unsigned tl = 0;
+		while( *list && *list != PROTOCOL_LIST_SEPARATOR ) {
+			if( tl < sizeof( token ) - 1 ) {
+				token[tl++] = *list;
+			}
+			list++;
+		}
+
+		if( *list ) {
+			list++;
+		}
+
+		token[tl] = 0;
+
+		cstr attrName = __value;
+		char* sep = strchr( token, ':' );
+		if( sep ) {
+			*sep = 0;
+			attrName = sep + 1;
+		}
+
+		// format the item
+		char item[96];
+		cstr state;
+		cstr value = "";
+		char buffer[32];
+
+		rawProperty* prop = findProperty( token );
+		rawAttribute* attr = prop ? findAttr( prop, attrName ) : NULL;
+
+		if( !prop ) {
+			state = "M01";
+		}
+		else if( !attr ) {
+			state = "M02";
+		}
+		else {
+			pfnHandler handler = propHandler( prop );
+			if( handler && attr == prop->attrs ) {
+				// the handler sees a GET of the item, what it sends is dropped
+				char* parts[5] = { (char*)"GET", token, (char*)attrName, NULL, NULL };
+				Request get( parts, req->getSession( ) );
+				Response scratch( NULL, false );
+
+				PROFILE_SCOPE( PROFILE_HANDLER );
+				handler( MsgGet, &get, &scratch, &attr->value );
+			}
+
+			state = calcPropState( attr->value.attrs );
+			value = valueToStr( attr, buffer );
+		}
+
+		unsigned il = formatItem( item, sizeof( item ), token, attrName, state, value );
+
+		// item does not fit, what we had is sent
+		if( appendItem( res, "MGET", Value( first ).toStr( ), item, il ) ) {
+			first = index;
+		}
+
+		index++;
+	}
+
+	endItems( res, "MGET", Value( first ).toStr( ) );
+	return 0;
+}
+
+/**
+ * handle CHANGED command
+ * CHANGED;REV all attributes modified after the revision REV are sent
+ * 	M00;CHANGED;<current revision>;<MORE|OK>;PROP:ATTR:STATE:VALUE,...
+ * the host keeps the current revision for its next request
+ * if REV is after the current revision (device restarted), all attributes are sent
+ */
+
+int processPropertyChanged( Request* req, Response* res ) {
+
+	cstr since = req->getProperty( );
+	if( !isValidNumber( since, false ) ) {
+		res->sendError( "M08", "BAD VALUE" );
+		return -1;
+	}
+
+	uint32_t rev = str_to_u32( since );
+	if( rev > revision ) {
+		rev = 0;
+	}
+
+	char tag[11];
+	u32_to_str( revision, tag );
+
+	for( rawProperty* p = properties; p; p = p->next ) {
+		if( isCommand( p ) ) {
+			continue;
+		}
+
+		for( rawAttribute* a = p->attrs; a; a = a->next ) {
+			if( a->rev <= rev ) {
+				continue;
+			}
+
+			char item[96];
+			char buffer[32];
+			unsigned il = formatItem( item, sizeof( item ), propName( p ), attrName( a ), calcPropState( a->value.attrs ), valueToStr( a, buffer ) );
+			appendItem( res, "CHANGED", tag, item, il );
+		}
+	}
+
+	endItems( res, "CHANGED", tag );
+	return 0;
+}
+
+/**
+ * handle SUBSCRIBE & UNSUBSCRIBE commands
+ * SUBSCRIBE;PROP[;ATTR] the session will receive an event on each change
+ * 	of the attribute value or state: EVT;PROP;ATTR;STATE;VALUE*CK
+ * UNSUBSCRIBE;PROP[;ATTR]
+ * UNSUBSCRIBE;ALL
+ */
+
+int processPropertySubscribe( Request* req, Response* res, bool subscribe ) {
+
+	ProtocolSession* session = req->getSession( );
+	uint8_t mask = session ? session->getMask( ) : 0;
+	if( !mask ) {
+		res->sendError( "M11", "NO EVENT SLOT" );
+		return -1;
+	}
+
+	if( !subscribe && str_eq( req->getProperty( ), "ALL" ) ) {
+		for( rawProperty* p = properties; p; p = p->next ) {
+			for( rawAttribute* a = p->attrs; a; a = a->next ) {
+				a->subs &= ~mask;
+				a->dirty &= ~mask;
+			}
+		}
+
+		res->send( req->getCommand( ), "ALL", "OK", NULL );
+		return 0;
+	}
+
+	rawProperty* prop = findProperty( req->getProperty( ), req->getPropertyHash( ) );
+	if( !prop ) {
+		res->sendError( "M01", "UNKNOWN PROPERTY" );
+		return -1;
+	}
+
+	cstr name = req->getValueStr( 0 );
+	rawAttribute* attr = findAttr( prop, *name ? name : __value );
+	if( !attr ) {
+		res->sendError( "M02", "UNKNOWN ATTRIBUTE" );
+		return -1;
+	}
+
+	if( subscribe ) {
+		attr->subs |= mask;
 	}
 	else {
-		cstr cmd = req->getCommand( );
-		rawProperty* p = findProperty( cmd );
+		attr->subs &= ~mask;
+		attr->dirty &= ~mask;
+	}
+
+	static char buffer[32];
+	res->send( propName( prop ), attrName( attr ), calcPropState( attr->value.attrs ), valueToStr( attr, buffer ) );
+	return 0;
+}
 
-		if( p ) {
-			if( p->handler ) {
-				p->handler( MsgCmd, req, res, NULL );
+/**
+ * handle WAIT command
+ * WAIT;PROP[;STATE[;TIMEOUT_MS]] answer when the property leaves the state (BUSY by default)
+ * or on timeout: M00;WAIT;PROP;STATE;VALUE*CK
+ * the answer is deferred, next requests are processed meanwhile
+ */
+
+int processPropertyWait( Request* req, Response* res ) {
+
+	ProtocolSession* session = req->getSession( );
+	uint8_t mask = session ? session->getMask( ) : 0;
+	if( !mask ) {
+		res->sendError( "M11", "NO EVENT SLOT" );
+		return -1;
+	}
+
+	rawProperty* prop = findProperty( req->getProperty( ), req->getPropertyHash( ) );
+	if( !prop || !prop->attrs || isCommand( prop ) ) {
+		res->sendError( "M01", "UNKNOWN PROPERTY" );
+		return -1;
+	}
+
+	// state to leave
+	cstr name = req->getValueStr( 0 );
+	uint8_t state = PROPERTY_STATE_BUSY;
+
+	if( *name ) {
+		state = 0xFF;
+		for( uint8_t s = PROPERTY_STATE_READY; s <= PROPERTY_STATE_NA; s += PROPERTY_STATE_BUSY ) {
+			if( str_eq_c( name, calcPropState( s ) ) ) {
+				state = s;
 			}
-			else {
-				cstr prop = req->getProperty( );
-				rawAttribute* a = findAttr( p, prop );
+		}
+	}
 
-				if( a && a->handler ) {
-					a->handler( MsgCmd, req, res, NULL );
-				}
+	// ms on 32 bits (int is 16 bits on AVR)
+	cstr timeout = req->getValueStr( 1 );
+	const uint32_t ms = *timeout ? str_to_u32( timeout ) : PROPERTY_WAIT_TIMEOUT_MS;
+	if( state == 0xFF || ( *timeout && ( !isValidNumber( timeout, false ) || *timeout == '-' ) ) || ms > PROPERTY_WAIT_MAX_MS ) {
+		res->sendError( "M08", "BAD VALUE" );
+		return -1;
+	}
+
+	rawAttribute* a = prop->attrs;
+	if( ( a->value.attrs & PROPERTY_STATE_MASK ) != state ) {
+		static char buffer[32];
+		res->send( "WAIT", propName( prop ), calcPropState( a->value.attrs ), valueToStr( a, buffer ) );
+		return 0;
+	}
+
+	WaitSlot* w = getWaitSlot( mask );
+	if( w->prop ) {
+		res->sendError( "M12", "WAIT PENDING" );
+		return -1;
+	}
+
+	w->prop = prop;
+	w->state = state;
+	w->deadline = millis( ) + ms;
+	return 0;
+}
+
+/**
+ * handle STREAM command
+ * STREAM;PROP;PERIOD_MS the session receives a sample of the property every PERIOD_MS:
+ * 	SMP;PROP;TIMESTAMP;STATE;VALUE*CK
+ * STREAM;PROP;OFF
+ * STREAM;ALL;OFF
+ */
+
+int processPropertyStream( Request* req, Response* res ) {
+
+	ProtocolSession* session = req->getSession( );
+	uint8_t mask = session ? session->getMask( ) : 0;
+	if( !mask ) {
+		res->sendError( "M11", "NO EVENT SLOT" );
+		return -1;
+	}
+
+	cstr period = req->getValueStr( 0 );
+	const bool off = str_eq_c( period, "OFF" );
+
+	if( off && str_eq( req->getProperty( ), "ALL" ) ) {
+		for( unsigned i = 0; i < PROPERTY_MAX_STREAMS; i++ ) {
+			if( streams[i].mask == mask ) {
+				streams[i].prop = NULL;
 			}
 		}
 
-		if( !res->isDone() ) {
-			res->sendError( "M06", "UNKNOWN COMMAND");
-			return 1;
+		res->send( "STREAM", "ALL", "OK", "OFF" );
+		return 0;
+	}
+
+	rawProperty* prop = findProperty( req->getProperty( ), req->getPropertyHash( ) );
+	if( !prop || !prop->attrs || isCommand( prop ) ) {
+		res->sendError( "M01", "UNKNOWN PROPERTY" );
+		return -1;
+	}
+
+	// ms on 32 bits (int is 16 bits on AVR)
+	if( !off && ( !isValidNumber( period, false ) || *period == '-' || str_to_u32( period ) < PROPERTY_STREAM_MIN_MS ) ) {
+		res->sendError( "M08", "BAD VALUE" );
+		return -1;
+	}
+
+	// slot of this property for the session, else a free one
+	StreamSlot* st = NULL;
+	for( unsigned i = 0; i < PROPERTY_MAX_STREAMS; i++ ) {
+		if( streams[i].prop == prop && streams[i].mask == mask ) {
+			st = &streams[i];
+			break;
+		}
+
+		if( !st && !streams[i].prop ) {
+			st = &streams[i];
+		}
+	}
+
+	if( off ) {
+		if( st && st->prop == prop ) {
+			st->prop = NULL;
+		}
+
+		res->send( "STREAM", propName( prop ), "OK", "OFF" );
+		return 0;
+	}
+
+	if( !st ) {
+		res->sendError( "M13", "NO STREAM SLOT" );
+		return -1;
+	}
+
+	// index of the property for binary samples
+	uint8_t index = 0;
+	for( rawProperty* p = properties; p != prop; p = p->next ) {
+		if( !isCommand( p ) ) {
+			index++;
+		}
+	}
+
+	st->prop = prop;
+	st->mask = mask;
+	st->index = index;
+	st->state = 0xFF;
+	st->period = str_to_u32( period );
+	st->next = millis( );
+
+	res->send( "STREAM", propName( prop ), "OK", period );
+	return 0;
+}
+
+/**
+ * handle STOP command, received by the priority lane
+ * STOP;PROP the tasks of the property are cancelled, the property handler receives MsgStop,
+ * 	the answer is the VALUE attribute
+ * STOP;ALL all tasks are cancelled, every property handler receives MsgStop: M00;STOP;ALL;OK
+ */
+
+int processPropertyStop( Request* req, Response* res ) {
+
+	if( str_eq( req->getProperty( ), "ALL" ) ) {
+		cancelPropertyTasks( NULL );
+
+#ifdef USIS_COROUTINES
+		for( rawProperty* p = properties; p; p = p->next ) {
+			if( p->attrs && !isCommand( p ) ) {
+				cancelCoroutines( p );
+			}
+		}
+
+		cancelCoroutines( NULL ); // commands
+#endif
+
+		for( rawProperty* p = properties; p; p = p->next ) {
+			pfnHandler handler = propHandler( p );
+			if( handler && p->attrs && !isCommand( p ) ) {
+				PROFILE_SCOPE( PROFILE_HANDLER );
+				handler( MsgStop, req, res, &p->attrs->value );
+			}
+		}
+
+		if( !res->isDone( ) ) {
+			res->send( "STOP", "ALL", "OK", NULL );
+		}
+
+		return 0;
+	}
+
+	rawProperty* prop = findProperty( req->getProperty( ), req->getPropertyHash( ) );
+	if( !prop || !prop->attrs || isCommand( prop ) ) {
+		res->sendError( "M01", "UNKNOWN PROPERTY" );
+		return -1;
+	}
+
+	cancelPropertyTasks( prop );
+#ifdef USIS_COROUTINES
+	cancelCoroutines( prop );
+#endif
+
+	rawAttribute* attr = prop->attrs;
+	pfnHandler handler = propHandler( prop );
+	if( handler ) {
+		PROFILE_SCOPE( PROFILE_HANDLER );
+		handler( MsgStop, req, res, &attr->value );
+	}
+
+	if( !res->isDone( ) ) {
+		static char buffer[32];
+		res->send( replyName( req->getProperty( ), propName( prop ) ), attrName( attr ), calcPropState( attr->value.attrs ), valueToStr( attr, buffer ) );
+	}
+
+	return 0;
+}
+
+/**
+ * handle CALIB;PROP;VALUE
+ * the VALUE attribute (INT or FLOAT, even readonly) is set to the given value without moving,
+ * the handler receives MsgCalib, the value is saved
+ */
+
+int processPropertyCalib( Request* req, Response* res ) {
+
+	rawProperty* prop = findProperty( req->getProperty( ), req->getPropertyHash( ) );
+	if( !prop || !prop->attrs || isCommand( prop ) ) {
+		res->sendError( "M01", "UNKNOWN PROPERTY" );
+		return -1;
+	}
+
+	rawAttribute* attr = prop->attrs;
+	const uint8_t type = attr->value.attrs & PROPERTY_TYPE_MASK;
+
+	cstr v = req->getValueStr( 0 );
+	if( !v || *v == 0 ) {
+		res->sendError( "M05", "NO VALUE GIVEN" );
+		return -1;
+	}
+
+	if( ( type != PROPERTY_TYPE_INT && type != PROPERTY_TYPE_FLOAT ) || !isValidNumber( v, type == PROPERTY_TYPE_FLOAT ) ) {
+		res->sendError( "M04", "BAD VALUE TYPE" );
+		return -1;
+	}
+
+	if( type == PROPERTY_TYPE_FLOAT ) {
+		forceAttr( attr, str_to_f( v ) );
+	}
+	else {
+		forceAttr( attr, str_to_i( v ) );
+	}
+
+	saveAttribute( prop, attr );
+
+	pfnHandler handler = propHandler( prop );
+	if( handler ) {
+		PROFILE_SCOPE( PROFILE_HANDLER );
+		handler( MsgCalib, req, res, &attr->value );
+	}
+
+	if( !res->isDone( ) ) {
+		static char buffer[32];
+		res->send( replyName( req->getProperty( ), propName( prop ) ), attrName( attr ), calcPropState( attr->value.attrs ), valueToStr( attr, buffer ) );
+	}
+
+	return 0;
+}
+
+/**
+ * restore the attributes of a property, the handler receives MsgReset
+ */
+
+static void factoryReset( Request* req, Response* res, rawProperty* prop ) {
+	for( rawAttribute* a = prop->attrs; a; a = a->next ) {
+		resetAttr( a );
+	}
+
+	pfnHandler handler = propHandler( prop );
+	if( handler ) {
+		PROFILE_SCOPE( PROFILE_HANDLER );
+		handler( MsgReset, req, res, &prop->attrs->value );
+	}
+}
+
+/**
+ * handle FACTORY_RESET;PROP: M00;PROP;TYPE;UNIT;PREC (as INFO;PROP)
+ * FACTORY_RESET;ALL: M00;FACTORY_RESET;ALL;OK
+ * the reset is saved
+ */
+
+int processPropertyFactoryReset( Request* req, Response* res ) {
+
+	if( str_eq( req->getProperty( ), "ALL" ) ) {
+		for( rawProperty* p = properties; p; p = p->next ) {
+			if( p->attrs && !isCommand( p ) ) {
+				factoryReset( req, res, p );
+			}
+		}
+
+		saveFactoryReset( NULL );
+
+		if( !res->isDone( ) ) {
+			res->send( "FACTORY_RESET", "ALL", "OK", NULL );
+		}
+
+		return 0;
+	}
+
+	rawProperty* prop = findProperty( req->getProperty( ), req->getPropertyHash( ) );
+	if( !prop || !prop->attrs || isCommand( prop ) ) {
+		res->sendError( "M01", "UNKNOWN PROPERTY" );
+		return -1;
+	}
+
+	factoryReset( req, res, prop );
+	saveFactoryReset( prop );
+
+	if( !res->isDone( ) ) {
+		static char unit[32];
+		static char prec[32];
+		rawAttribute* u = getAttr( prop, ATTR_UNIT );
+		rawAttribute* p = getAttr( prop, ATTR_PREC );
+
+		res->send( replyName( req->getProperty( ), propName( prop ) ), getAttrTypeText( prop->attrs->value.attrs ), u ? valueToStr( u, unit ) : "", p ? valueToStr( p, prec ) : "" );
+	}
+
+	return 0;
+}
+
+/**
+ * handle SET command
+ */
+
+int processPropertySet( Request* req, Response* res ) {
+
+	// get property
+	rawProperty* prop = findProperty( req->getProperty( ), req->getPropertyHash( ) );
+	if( !prop ) {
+		res->sendError( "M01", "UNKNOWN PROPERTY" );
+		return -1;
+	}
+
+	// search given attribute
+	rawAttribute* attr = findAttr( prop, req->getAttr( ), req->getAttrHash( ) );
+	if( !attr ) {
+		res->sendError( "M02", "UNKNOWN ATTRIBUTE" );
+		return -1;
+	}
+
+	// get value & convert to the correct type
+	int rc = -2;
+	cstr v = req->getValueStr( 1 );
+	if( !v || *v==0 ) {
+		res->sendError( "M05", "NO VALUE GIVEN" );
+		return -1;
+	}
+
+#ifdef USIS_COROUTINES
+	// the value is not stored if the handler cannot run
+	if( attr == prop->attrs && propCoroutine( prop ) && !coroutineAvailable( ) ) {
+		res->sendError( "M14", "NO TASK SLOT" );
+		return -1;
+	}
+#endif
+
+	switch( attr->value.attrs & PROPERTY_TYPE_MASK ) {
+		case PROPERTY_TYPE_INT: {
+			// check all chars are digits
+			if( !isValidNumber(v,false) ) {
+				break;
+			}
+			
+			rc = setAttr( attr, str_to_i(v) );
+			break;
+		}
+
+		case PROPERTY_TYPE_FLOAT: {
+			if( !isValidNumber(v,true) ) {
+				break;
+			}
+			
+			rc = setAttr( attr, str_to_f(v) );
+			break;
 		}
+
+		case PROPERTY_TYPE_ENUM: {
+			rc = setAttr( attr, v );
+			break;
+		}
+
+		case PROPERTY_TYPE_CSTR: {
+			rc = setAttrText( attr, v );
+			break;
+		}
+	}
+
+	switch( rc ) {
+		case -1: {
+			res->sendError( "M03", "READONLY" );
+			return -1;
+		}
+
+		case -2: {
+			res->sendError( "M04", "BAD VALUE TYPE" );
+			return -1;
+		}
+
+		case -3: {
+			res->sendError( "M08", "BAD VALUE" );
+			return -1;
+		}
+	}
+
+	saveAttribute( prop, attr );
+
+	pfnHandler handler = propHandler( prop );
+	if( handler && attr == prop->attrs ) {
+		PROFILE_SCOPE( PROFILE_HANDLER );
+		handler( MsgSet, req, res, &attr->value );
+	}
+
+	if( !res->isDone() ) {
+		sendAttribute( req, res, prop, attr );
+		return 1;
+	}
+
+	return 0;
+}
+
+#if defined( USIS_PROFILE ) || TRACE_SIZE
+
+/**
+ * handle the SYSTEM requests of the library
+ * SYSTEM;PROFILE sends the request pipeline statistics (cf. profile.h)
+ * SYSTEM;PROFILE_RESET clears them: M00;SYSTEM;PROFILE_RESET;OK
+ * SYSTEM;TRACE sends the trace records (cf. trace.h)
+ * @return false if the request is not one of them
+ */
+
+static bool processSystem( Request* req, Response* res ) {
+#ifdef USIS_PROFILE
+	if( str_eq( req->getProperty( ), "PROFILE" ) ) {
+		processProfile( req, res );
+		return true;
+	}
+
+	if( str_eq( req->getProperty( ), "PROFILE_RESET" ) ) {
+		resetProfile( );
+		res->send( "SYSTEM", "PROFILE_RESET", "OK", NULL );
+		return true;
+	}
+#endif
+
+#if TRACE_SIZE
+	if( str_eq( req->getProperty( ), "TRACE" ) ) {
+		processTrace( req, res );
+		return true;
+	}
+#endif
+
+	return false;
+}
+
+#endif
+
+/**
+ * the firmware defines a command with the name of a standard one (COMMAND_START( "STOP" ), "CALIB"...)
+ * it keeps receiving it as MsgCmd
+ */
+
+static bool isApplicationCommand( Request* req ) {
+	rawProperty* p = findProperty( req->getCommand( ), req->getCommandHash( ) );
+	return p && isCommand( p );
+}
+
+/**
+ * process message according to the properties defined in the application
+ *
+ * @return -1 in case of error
+ * 			0 in case of success
+ * 			1 in case of command not handled
+ */
+
+int processProperty( Request* req, Response* res ) {
+
+	if( req->isBinary( ) ) {
+		return processBinary( req, res );
+	}
+
+	switch( req->getCommandId( ) ) {
+		case CMD_GET: {
+			return processPropertyGet( req, res );
+		}
+
+		case CMD_SET: {
+			return processPropertySet( req, res );
+		}
+
+		case CMD_INFO: {
+			return processIntrospection( req, res );
+		}
+
+		case CMD_MGET: {
+			return processPropertyMGet( req, res );
+		}
+
+		case CMD_CHANGED: {
+			return processPropertyChanged( req, res );
+		}
+
+		case CMD_SUBSCRIBE: {
+			return processPropertySubscribe( req, res, true );
+		}
+
+		case CMD_UNSUBSCRIBE: {
+			return processPropertySubscribe( req, res, false );
+		}
+
+		case CMD_WAIT: {
+			return processPropertyWait( req, res );
+		}
+
+		case CMD_STOP: {
+			if( isApplicationCommand( req ) ) {
+				break;
+			}
+
+			return processPropertyStop( req, res );
+		}
+
+		case CMD_STREAM: {
+			return processPropertyStream( req, res );
+		}
+
+		case CMD_CALIB: {
+			if( isApplicationCommand( req ) ) {
+				break;
+			}
+
+			return processPropertyCalib( req, res );
+		}
+
+		case CMD_FACTORY_RESET: {
+			if( isApplicationCommand( req ) ) {
+				break;
+			}
+
+			return processPropertyFactoryReset( req, res );
+		}
+
+#if defined( USIS_PROFILE ) || TRACE_SIZE
+		case CMD_SYSTEM: {
+			if( processSystem( req, res ) ) {
+				return 0;
+			}
+
+			break; // application SYSTEM commands
+		}
+#endif
+	}
+
+	// application commands (commands have no handle)
+	cstr command = req->getCommand( );
+	rawProperty* p = *command != PROPERTY_HANDLE_PREFIX ? findProperty( command, req->getCommandHash( ) ) : NULL;
+
+	if( p ) {
+		pfnHandler handler = propHandler( p );
+		if( handler ) {
+			PROFILE_SCOPE( PROFILE_HANDLER );
+			handler( MsgCmd, req, res, NULL );
+		}
+		else {
+			cstr prop = req->getProperty( );
+			rawAttribute* a = findAttr( p, prop );
+
+			handler = a ? attrHandler( a ) : NULL;
+			if( handler ) {
+				PROFILE_SCOPE( PROFILE_HANDLER );
+				handler( MsgCmd, req, res, NULL );
+			}
+		}
+	}
+
+	if( !res->isDone() ) {
+		res->sendError( "M06", "UNKNOWN COMMAND");
+		return 1;
 	}
 
 	return 0;
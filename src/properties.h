@@ -33,6 +33,94 @@
 
 #define PROPERTY_FLAG_READONLY 0b10000000 // the propertty is readonly
 
+// max count of attributes in the attributes table
+// properties beyond are still working, but with list walks
+#ifndef PROPERTY_MAX_ATTRIBUTES
+#	if defined( __AVR__ )
+#		define PROPERTY_MAX_ATTRIBUTES 64
+#	else
+#		define PROPERTY_MAX_ATTRIBUTES 255
+#	endif
+#endif
+
+#define PROPERTY_NO_INDEX 0xFF // property attributes are not in the table
+
+// max count of properties reachable through handles (#n) without list walk
+// commands are not counted
+#ifndef PROPERTY_MAX_HANDLES
+#	if defined( __AVR__ )
+#		define PROPERTY_MAX_HANDLES 32
+#	else
+#		define PROPERTY_MAX_HANDLES 255
+#	endif
+#endif
+
+// WAIT timeout when not given
+#ifndef PROPERTY_WAIT_TIMEOUT_MS
+#	define PROPERTY_WAIT_TIMEOUT_MS 10000
+#endif
+
+// max WAIT timeout, longer ones are refused (deadlines are compared on 31 bits)
+#ifndef PROPERTY_WAIT_MAX_MS
+#	define PROPERTY_WAIT_MAX_MS 3600000ul
+#endif
+
+// count of properties that can be streamed at the same time (all links)
+#ifndef PROPERTY_MAX_STREAMS
+#	if defined( __AVR__ )
+#		define PROPERTY_MAX_STREAMS 4
+#	else
+#		define PROPERTY_MAX_STREAMS 16
+#	endif
+#endif
+
+// min STREAM period, bounds the link usage
+#ifndef PROPERTY_STREAM_MIN_MS
+#	define PROPERTY_STREAM_MIN_MS 10
+#endif
+
+#define PROPERTY_HANDLE_PREFIX '#' // #<index> can replace a property, attribute or enum value name
+
+/**
+ * well known attributes (cf. specification)
+ */
+
+enum AttrKey
+{
+	ATTR_VALUE = 0,
+	ATTR_MIN,
+	ATTR_MAX,
+	ATTR_UNIT,
+	ATTR_PREC,
+	ATTR_KNOWN_COUNT,
+
+	ATTR_OTHER = 0xFF, // application attribute
+};
+
+// count of buckets of the properties hash table (power of 2)
+// 0: no table, properties are scanned in a list ordered by use (cf. reorderProperties)
+#ifndef PROPERTY_HASH_SIZE
+#	if defined( __AVR__ )
+#		define PROPERTY_HASH_SIZE 8
+#	else
+#		define PROPERTY_HASH_SIZE 32
+#	endif
+#endif
+
+// without hash table, count of lookups between two reorders of the list, 0 to keep the definition order
+#ifndef PROPERTY_REORDER_PERIOD
+#	define PROPERTY_REORDER_PERIOD 256
+#endif
+
+// max length of the TEXT values set by the host, each writable TEXT attribute keeps 2 buffers of this size
+#ifndef PROPERTY_TEXT_LEN
+#	if defined( __AVR__ )
+#		define PROPERTY_TEXT_LEN 16
+#	else
+#		define PROPERTY_TEXT_LEN 64
+#	endif
+#endif
+
 /**
  * internal, helper to store integer, float or char* value
  */
@@ -42,17 +130,35 @@ union __uv {
 	float fval;
 	cstr sval;
 	
-	__uv( int v ) {
-		ival = v;
+	constexpr __uv( int v ) : ival( v ) {
 	}
-	__uv( float v ) {
-		fval = v;
+	constexpr __uv( float v ) : fval( v ) {
 	}
-	__uv( cstr v ) {
-		sval = v;
+	constexpr __uv( cstr v ) : sval( v ) {
 	}
 };
 
+/**
+ * property descriptors are const and live in flash
+ * on AVR, they are in PROGMEM and must be read with the pgm_read functions
+ * CARE: names & enum values strings are still in RAM on AVR
+ */
+
+#if defined( __AVR__ )
+#	include <avr/pgmspace.h>
+#	define USIS_FLASH PROGMEM
+#	define flash_ptr( x ) pgm_read_ptr( &( x ) )
+#	define flash_u8( x ) pgm_read_byte( &( x ) )
+#	define flash_u16( x ) pgm_read_word( &( x ) )
+#	define flash_read( dst, src, len ) memcpy_P( dst, src, len )
+#else
+#	define USIS_FLASH
+#	define flash_ptr( x ) ( x )
+#	define flash_u8( x ) ( x )
+#	define flash_u16( x ) ( x )
+#	define flash_read( dst, src, len ) memcpy( dst, src, len )
+#endif
+
 /**
  * a simple variant holder
  * CARE: when storing char*, the value is not copied.
@@ -69,25 +175,130 @@ struct rawValue
 	};
 
 	uint8_t attrs; // PROPERTY_TYPE_<xxx> | PROPERTY_STATE_<xxx> | PROPERTY_FLAG_<xxx>
-	uint8_t ecount; // count of enums
-	cstr* evals; // possible enum values NULL term
 };
 #pragma pack( pop )
 
+struct rawAttributeDesc;
+
 int set_variant( rawValue* var, float v );
 int set_variant( rawValue* var, int v );
-int set_variant( rawValue* var, cstr v );
+int set_variant( rawValue* var, cstr v, const rawAttributeDesc* desc = NULL ); // enums: desc is searched when not given
+
+/**
+ * descriptor of the attribute holding the value (ex: value given to a handler), NULL if none
+ * the enum values are reached from it (ecount & evals moved out of rawValue)
+ */
+
+const rawAttributeDesc* valueDesc( const rawValue* var );
+
+/**
+ * messages received by the handlers
+ * property handlers also receive MsgStop, MsgCalib & MsgReset, a handler must ignore the messages it does not know
+ * MsgGet is also sent for each VALUE item of MGET, with a GET request of the item: the handler updates the value,
+ * a response it sends is dropped (the item is part of the MGET frame)
+ * they are not sent when the firmware defines its own STOP, CALIB or FACTORY_RESET command (COMMAND_START( "STOP" )...),
+ * which gets MsgCmd
+ */
 
 enum PropertyMsg
 {
 	MsgSet = 1,
 	MsgGet = 2,
 	MsgCmd = 3,
+	MsgStop = 4, // STOP;PROP or STOP;ALL, value is the VALUE attribute, the device answers (the handler should not)
+	MsgCalib = 5, // CALIB;PROP;VALUE, value is the new VALUE for the current position
+	MsgReset = 6, // FACTORY_RESET, attributes are back to their initial values
 };
 
 //	function prototype when a value is changing
 typedef void ( *pfnHandler )( PropertyMsg msg, Request* req, Response* res, rawValue* value );
 
+/**
+ * const part of a property (flash)
+ */
+
+struct rawPropertyDesc
+{
+	cstr name; // property name
+	uint16_t hash; // str_hash of the name
+	pfnHandler handler; // property callback
+	bool coroutine; // handler is a COROUTINE_HANDLER (needs a free frame to accept SET)
+};
+
+/**
+ * handler given by COROUTINE_HANDLER, so the property knows it at compile time
+ */
+
+struct CoroutineHandler
+{
+	pfnHandler handler;
+
+	constexpr explicit CoroutineHandler( pfnHandler h ) : handler( h ) {
+	}
+
+	constexpr operator pfnHandler( ) const {
+		return handler;
+	}
+};
+
+constexpr bool __isCoroutineHandler( pfnHandler ) {
+	return false;
+}
+
+constexpr bool __isCoroutineHandler( CoroutineHandler ) {
+	return true;
+}
+
+/**
+ * const part of an attribute (flash)
+ */
+
+struct rawAttributeDesc
+{
+	cstr name; // attr name
+	uint8_t key; // ATTR_xxx
+	uint8_t attrs; // initial PROPERTY_TYPE_<xxx> | PROPERTY_STATE_<xxx> | PROPERTY_FLAG_<xxx>
+	uint8_t ecount; // count of enums
+	const cstr* evals; // possible enum values
+	pfnHandler handler; // attribute callback
+	__uv init; // initial value
+	char* text; // writable TEXT: storage of the values set by the host (2 buffers), NULL otherwise
+};
+
+/**
+ * size of the text storage of an attribute, compile time (1 when not needed)
+ */
+
+constexpr unsigned __textSize( uint8_t attrs ) {
+	return ( attrs & PROPERTY_TYPE_MASK ) == PROPERTY_TYPE_CSTR && !( attrs & PROPERTY_FLAG_READONLY ) ? 2 * ( PROPERTY_TEXT_LEN + 1 ) : 1;
+}
+
+/**
+ * well known attribute key of a name, compile time
+ */
+
+constexpr uint8_t __attrKey( cstr name ) {
+	return str_eq_c( name, "VALUE" ) ? ATTR_VALUE
+		: str_eq_c( name, "MIN" ) ? ATTR_MIN
+		: str_eq_c( name, "MAX" ) ? ATTR_MAX
+		: str_eq_c( name, "UNIT" ) ? ATTR_UNIT
+		: str_eq_c( name, "PREC" ) ? ATTR_PREC
+		: ATTR_OTHER;
+}
+
+/**
+ * compile time hash of a definition: name, type & flags, enum values (their strings, macros expanded)
+ * initial values and handlers are not part of the schema
+ */
+
+constexpr uint32_t __schemaHashEnums( const cstr* evals, unsigned count, uint32_t h ) {
+	return count ? __schemaHashEnums( evals + 1, count - 1, ( str_hash32_c( *evals, h ) ^ ',' ) * STR_HASH32_PRIME ) : h;
+}
+
+constexpr uint32_t __schemaHash( cstr name, uint8_t attrs, const cstr* evals = nullptr, unsigned count = 0 ) {
+	return __schemaHashEnums( evals, count, ( str_hash32_c( name ) ^ attrs ) * STR_HASH32_PRIME );
+}
+
 #define NULL_TERM( ... ) \
 	{ ##__VA_ARGS__, NULL }
 
@@ -96,26 +307,39 @@ typedef void ( *pfnHandler )( PropertyMsg msg, Request* req, Response* res, rawV
 // CARE: ival mut match the property type
 // ie. 	if property type is float, ival must of type float
 //		if property type is enum, ival must be of type int
+// names must be string literals (descriptors are built at compile time)
 #define PROPERTY_START( name, attr, ival, handler, ... ) \
 	{ \
+		__PHF_CHECK( name ) \
 		static rawProperty p; \
-		static int8_t uid = 0; \
-		static rawAttribute pv; \
 		{ \
-			static const cstr _name = name; \
-			static const cstr e[] = { __VA_ARGS__ }; \
-			__makeProperty( &p, _name, handler ); \
-			__addAttribute( &p, &pv, NULL, attr, ival, count_of( e ), (cstr*)e, NULL ); \
-			pv.id = uid++; \
+			static rawAttribute pv; \
+			static constexpr cstr e[] USIS_FLASH = { __VA_ARGS__ }; \
+			static char t[__textSize( attr )]; \
+			static const rawPropertyDesc pd USIS_FLASH = { name, str_hash_c( name ), handler, __isCoroutineHandler( handler ) }; \
+			static const rawAttributeDesc ad USIS_FLASH = { "VALUE", ATTR_VALUE, attr, count_of( e ), e, NULL, __uv( ival ), __textSize( attr ) > 1 ? t : NULL }; \
+			static constexpr uint32_t sh = __schemaHash( name, attr, e, count_of( e ) ); \
+			__makeProperty( &p, &pd, sh ); \
+			__addAttribute( &p, &pv, &ad, 0 ); \
 		}
 
 #define PROPERTY_ATTR( name, attr, ival, ... ) \
 	{ \
 		static rawAttribute pv; \
-		static const cstr _name = name; \
-		static const cstr e[] = { __VA_ARGS__ }; \
-		__addAttribute( &p, &pv, _name, attr, ival, count_of( e ), (cstr*)e, NULL ); \
-		pv.id = uid++; \
+		static constexpr cstr e[] USIS_FLASH = { __VA_ARGS__ }; \
+		static char t[__textSize( attr )]; \
+		static const rawAttributeDesc ad USIS_FLASH = { name, __attrKey( name ), attr, count_of( e ), e, NULL, __uv( ival ), __textSize( attr ) > 1 ? t : NULL }; \
+		static constexpr uint32_t sh = __schemaHash( name, attr, e, count_of( e ) ); \
+		__addAttribute( &p, &pv, &ad, sh ); \
+	}
+
+// history of the property value (INT, FLOAT & ENUM), cf. GET;PROP;HISTORY
+// size: count of samples kept, period: sample rate in ms, 0 to record each change
+#define PROPERTY_HISTORY( size, period ) \
+	{ \
+		static historySample hs[size]; \
+		static rawHistory h; \
+		__addHistory( &p, &h, hs, size, period ); \
 	}
 
 #define PROPERTY_END() \
@@ -125,14 +349,17 @@ typedef void ( *pfnHandler )( PropertyMsg msg, Request* req, Response* res, rawV
 	{ \
 		static rawProperty p; \
 		{ \
-			static const cstr _name = name; \
-			__makeProperty( &p, _name, NULL ); \
+			static const rawPropertyDesc pd USIS_FLASH = { name, str_hash_c( name ), NULL, false }; \
+			static constexpr uint32_t sh = __schemaHash( name, PROPERTY_TYPE_CMD ); \
+			__makeProperty( &p, &pd, sh ); \
 		} 
 
 #define COMMAND_HANDLER( name, handler ) \
 	{ \
 		static rawAttribute pv; \
-		__addAttribute( &p, &pv, name, PROPERTY_TYPE_CMD, 0, 0, NULL, handler ); \
+		static const rawAttributeDesc ad USIS_FLASH = { name, __attrKey( name ), PROPERTY_TYPE_CMD, 0, NULL, handler, __uv( 0 ), NULL }; \
+		static constexpr uint32_t sh = __schemaHash( name, PROPERTY_TYPE_CMD ); \
+		__addAttribute( &p, &pv, &ad, sh ); \
 	}		
 		
 #define COMMAND_END() \
@@ -140,21 +367,24 @@ typedef void ( *pfnHandler )( PropertyMsg msg, Request* req, Response* res, rawV
 
 
 #define PROPERTIES_END() \
+	__initProperties(); \
 	return properties; \
 	} \
 	rawProperty* properties = __makeProps();
 
 /**
  * raw definition of a property attribute
+ * only the mutable part is in RAM, cf. rawAttributeDesc
  */
 
 struct rawAttribute
 {
-	cstr name; // attr name
-	uint8_t id; // attr id
-	rawValue value; // attr value
-	pfnHandler handler; // attribute callback
+	const rawAttributeDesc* desc; // const part
 	rawAttribute* next; // next in list, NULL for last
+	rawValue value; // attr value & state
+	uint32_t rev; // revision of the last change
+	uint8_t subs; // sessions subscribed to changes (one bit per session)
+	uint8_t dirty; // sessions to notify
 };
 
 /**
@@ -165,20 +395,235 @@ struct rawAttribute
 
 struct rawProperty
 {
-	cstr name; // property name
-	pfnHandler handler; // property callback
+	const rawPropertyDesc* desc; // const part
 	rawAttribute* attrs; // chained attributes
 	rawProperty* next; // next in list, NULL for last
+	rawProperty* hnext; // next in the same hash bucket, or in lookup order without hash table
+	uint8_t first; // index of the first attribute in the attributes table, PROPERTY_NO_INDEX if none
+	uint8_t count; // count of attributes
+	uint8_t known[ATTR_KNOWN_COUNT]; // index + 1 of the well known attributes, 0 if not defined
+
+#if PROPERTY_HASH_SIZE == 0
+	uint8_t hits; // lookups since the last reorder (halved on each one), saturated
+#endif
 };
 
+/**
+ * history of a property value (cf. PROPERTY_HISTORY)
+ * samples are a ring, the oldest one is overwritten
+ */
+
+struct historySample
+{
+	uint32_t time; // millis()
+	union {
+		int32_t ival;
+		float fval;
+	};
+};
+
+struct rawHistory
+{
+	rawHistory* next; // next history
+	rawProperty* prop; // recorded property
+	historySample* samples; // static storage
+	uint16_t size; // count of samples
+	uint32_t count; // samples recorded since startup, the last one is samples[(count-1) % size]
+	uint32_t period; // ms, 0 means on each change
+	long nextTime; // millis() of the next sample
+};
+
+/**
+ * descriptors accessors
+ */
+
+inline cstr propName( const rawProperty* p ) {
+	return (cstr)flash_ptr( p->desc->name );
+}
+
+inline uint16_t propHash( const rawProperty* p ) {
+	return flash_u16( p->desc->hash );
+}
+
+inline pfnHandler propHandler( const rawProperty* p ) {
+	return (pfnHandler)flash_ptr( p->desc->handler );
+}
+
+inline bool propCoroutine( const rawProperty* p ) {
+	return flash_u8( p->desc->coroutine );
+}
+
+inline cstr attrName( const rawAttribute* a ) {
+	return (cstr)flash_ptr( a->desc->name );
+}
+
+inline uint8_t attrKeyOf( const rawAttribute* a ) {
+	return flash_u8( a->desc->key );
+}
+
+inline pfnHandler attrHandler( const rawAttribute* a ) {
+	return (pfnHandler)flash_ptr( a->desc->handler );
+}
+
+inline uint8_t attrEnumCount( const rawAttribute* a ) {
+	return flash_u8( a->desc->ecount );
+}
+
+inline cstr attrEnumValue( const rawAttribute* a, int idx ) {
+	const cstr* evals = (const cstr*)flash_ptr( a->desc->evals );
+	return (cstr)flash_ptr( evals[idx] );
+}
+
 /**
  * global properties
  */
 
 extern rawProperty* properties;
 
-void __makeProperty( rawProperty* prop, cstr name, pfnHandler hanlder );
-void __addAttribute( rawProperty* prop, rawAttribute* pattr, cstr name, unsigned attr, const __uv& v, int nenum, cstr* enums, pfnHandler handler );
+/**
+ * global attributes table, attributes of a property are contiguous
+ * cf. rawProperty::first
+ */
+
+extern rawAttribute* attributes[PROPERTY_MAX_ATTRIBUTES];
+
+/**
+ * compile time perfect hash of the property names (C++14 and up)
+ * names are listed once, before PROPERTIES_START, and findProperty
+ * becomes a single table access for them:
+ *
+ * 	PROPERTY_NAMES( "GRATING_ANGLE", "LIGHT_SOURCE" );
+ * 	PROPERTIES_START( )
+ * 	...
+ *
+ * the table (displacements & names) is const, only the slots (one pointer
+ * per name) are in RAM. every PROPERTY_START name must be listed, this is
+ * checked at compile time (commands may be listed, or not). without C++14,
+ * PROPERTY_NAMES does nothing.
+ */
+
+// max displacement tried for a bucket
+#define PROPERTY_PHF_MAX_TRIES 2048
+
+constexpr uint16_t __phfSlot( uint16_t hash, uint16_t disp, unsigned count ) {
+	return (uint16_t)( ( (uint32_t)( hash ^ disp ) * 40503u ) >> 3 ) % count;
+}
+
+#if __cplusplus >= 201402L
+
+template <unsigned N>
+struct PerfectHash
+{
+	uint16_t disp[N]; // displacement of each bucket (bucket = hash % N)
+	cstr names[N]; // names by slot
+	bool ok; // all names have a slot
+};
+
+/**
+ * hash & displace: buckets are placed from the biggest one, each one
+ * gets the first displacement that moves all its names to free slots
+ * two names with the same hash can never be placed (ok = false)
+ */
+
+template <unsigned N>
+constexpr PerfectHash<N> __makePerfectHash( const cstr ( &names )[N] ) {
+	PerfectHash<N> r {};
+	uint16_t hashes[N] {};
+	unsigned sizes[N] {};
+	bool used[N] {};
+
+	for( unsigned i = 0; i < N; i++ ) {
+		hashes[i] = str_hash_c( names[i] );
+		sizes[hashes[i] % N]++;
+	}
+
+	r.ok = true;
+	for( unsigned size = N; size > 0; size-- ) {
+		for( unsigned b = 0; b < N; b++ ) {
+			if( sizes[b] != size ) {
+				continue;
+			}
+
+			bool placed = false;
+			for( unsigned d = 0; d < PROPERTY_PHF_MAX_TRIES && !placed; d++ ) {
+				bool taken[N] {};
+				placed = true;
+
+				for( unsigned i = 0; i < N && placed; i++ ) {
+					if( hashes[i] % N == b ) {
+						unsigned s = __phfSlot( hashes[i], d, N );
+						placed = !used[s] && !taken[s];
+						taken[s] = true;
+					}
+				}
+
+				if( placed ) {
+					r.disp[b] = d;
+					for( unsigned i = 0; i < N; i++ ) {
+						if( hashes[i] % N == b ) {
+							unsigned s = __phfSlot( hashes[i], d, N );
+							used[s] = true;
+							r.names[s] = names[i];
+						}
+					}
+				}
+			}
+
+			r.ok = r.ok && placed;
+		}
+	}
+
+	return r;
+}
+
+/**
+ * names given to PROPERTY_NAMES, checked by PROPERTY_START
+ * the macro specializes __phfList, none by default
+ */
+
+struct PerfectHashNames
+{
+	const cstr* names;
+	unsigned count;
+};
+
+template <int = 0>
+constexpr PerfectHashNames __phfList( ) {
+	return PerfectHashNames{ nullptr, 0 };
+}
+
+constexpr bool __phfListed( PerfectHashNames list, cstr name, unsigned i = 0 ) {
+	return list.count == 0 || ( i < list.count && ( str_eq_c( list.names[i], name ) || __phfListed( list, name, i + 1 ) ) );
+}
+
+#define __PHF_CHECK( name ) \
+	static_assert( __phfListed( __phfList<>( ), name ), "PROPERTY_NAMES: " name " is not listed" );
+
+#define PROPERTY_NAMES( ... ) \
+	static constexpr cstr __phfNames[] = { __VA_ARGS__ }; \
+	static constexpr PerfectHash<count_of( __phfNames )> __phf = __makePerfectHash( __phfNames ); \
+	static_assert( __phf.ok, "PROPERTY_NAMES: two names have the same hash, or no displacement found within PROPERTY_PHF_MAX_TRIES" ); \
+	template <> \
+	constexpr PerfectHashNames __phfList<0>( ) { \
+		return PerfectHashNames{ __phfNames, count_of( __phfNames ) }; \
+	} \
+	static rawProperty* __phfSlots[count_of( __phfNames )]; \
+	static const bool __phfSet = __setPerfectHash( __phf.disp, __phf.names, __phfSlots, count_of( __phfNames ) );
+
+#else
+
+#define __PHF_CHECK( name )
+#define PROPERTY_NAMES( ... )
+
+#endif
+
+bool __setPerfectHash( const uint16_t* disp, const cstr* names, rawProperty** slots, unsigned count );
+
+// schema: compile time hash of the definition (cf. __schemaHash), folded in getSchemaHash()
+void __makeProperty( rawProperty* prop, const rawPropertyDesc* desc, uint32_t schema );
+void __addAttribute( rawProperty* prop, rawAttribute* pattr, const rawAttributeDesc* desc, uint32_t schema );
+void __addHistory( rawProperty* prop, rawHistory* h, historySample* samples, uint16_t size, uint32_t period );
+void __initProperties( );
 
 /**
  * search for a property in all defined properties
@@ -191,6 +636,28 @@ void __addAttribute( rawProperty* prop, rawAttribute* pattr, cstr name, unsigned
 
 rawProperty* findProperty( cstr name );
 
+/**
+ * search for a property when the name hash is already known
+ * (ie. computed by the parser)
+ * @param name - the property we are looking for
+ * @param hash - str_hash( name )
+ * @returns the property or NULL
+ *
+ * @example
+ * 	rawProperty* prop = findProperty( req->getProperty(), req->getPropertyHash() );
+ */
+
+rawProperty* findProperty( cstr name, uint16_t hash );
+
+/**
+ * without hash table (PROPERTY_HASH_SIZE 0), the properties found most often are moved
+ * to the head of the lookup list, introspection & handles keep the definition order
+ * called from the messages loop, the list is only sorted every PROPERTY_REORDER_PERIOD lookups
+ * does nothing with a hash table
+ */
+
+void reorderProperties( );
+
 /**
  * search for an attribute in the property
  * @param prop - the property into we need to look
@@ -203,6 +670,51 @@ rawProperty* findProperty( cstr name );
 
 rawAttribute* findAttr( rawProperty* prop, cstr attrName );
 
+/**
+ * search for an attribute when the name hash is already known
+ * well known attributes are found by index
+ * @param prop - the property into we need to look
+ * @param attrName - the name we are looking at
+ * @param hash - str_hash( attrName )
+ * @return the attribute or NULL if not found
+ */
+
+rawAttribute* findAttr( rawProperty* prop, cstr attrName, uint16_t hash );
+
+/**
+ * well known attribute of a property
+ * @param prop - the property into we need to look
+ * @param key - ATTR_xxx
+ * @return the attribute or NULL if not defined
+ *
+ * @example
+ * 	rawAttribute* attr = getAttr( prop, ATTR_MIN );
+ */
+
+rawAttribute* getAttr( rawProperty* prop, uint8_t key );
+
+/**
+ * return the nth attribute of a property
+ * @return the attribute or NULL if not found
+ */
+
+rawAttribute* getAttributeByIndex( rawProperty* p, int idx );
+
+/**
+ * return the nth property
+ * @param skipCmd - commands are not counted (introspection & handles indexes)
+ * @return the property or NULL
+ */
+
+rawProperty* getPropertyByIndex( int idx, bool skipCmd );
+
+/**
+ * index given by a handle (#<index>)
+ * @return the index or -1 if name is not a handle
+ */
+
+int getHandleIndex( cstr name );
+
 /**
  * change an attribute value (float version)
  * @param attr - attribute we want to change
@@ -236,6 +748,28 @@ int setAttr( rawAttribute* a, int v );
 
 int setAttr( rawAttribute* a, cstr v );
 
+/**
+ * change a TEXT attribute with a value received from the host (SET)
+ * the value is copied in the attribute storage, the request buffer is reused for the next requests
+ * @return as setAttr, -3 if longer than PROPERTY_TEXT_LEN
+ */
+
+int setAttrText( rawAttribute* a, cstr v );
+
+/**
+ * change an attribute value even if it is readonly (calibration & persistence)
+ * the value is converted to the attribute type (INT, FLOAT & ENUM)
+ */
+
+void forceAttr( rawAttribute* a, float v );
+void forceAttr( rawAttribute* a, int v );
+
+/**
+ * restore the attribute type, flags, state & value given in the definition
+ */
+
+void resetAttr( rawAttribute* a );
+
 /**
  * change the property value (float version)
  * @param prop - the property to change
@@ -333,6 +867,32 @@ void setPropertyState( rawProperty* props, uint8_t state );
 
 bool setPropertyState( rawProperty* props, cstr attrName, uint8_t state );
 
+/**
+ * current revision of the properties
+ * incremented on each attribute value or state change
+ */
+
+uint32_t getRevision( );
+
+/**
+ * hash of the whole schema (properties, attributes, types, flags, enum values in definition order)
+ * it only changes when the definitions change, hosts can use it to cache the introspection
+ */
+
+uint32_t getSchemaHash( );
+
+/**
+ * items list sent in one or more frames:
+ * 	M00;<command>;<tag>;<MORE|OK>;item,item,...
+ * formatItem builds a PROP:ATTR:STATE:VALUE item and returns its length
+ * appendItem sends the pending items (MORE) when the new one does not fit and returns true in that case
+ * endItems sends the last frame (OK)
+ */
+
+unsigned formatItem( char* item, unsigned size, cstr prop, cstr attr, cstr state, cstr value );
+bool appendItem( Response* res, cstr command, cstr tag, const char* item, unsigned il );
+void endItems( Response* res, cstr command, cstr tag );
+
 /**
  * process message according to the properties defined in the application
  *
@@ -7,16 +7,89 @@
  **/
 
 #include "protocol.h"
+#include "properties.h"
+#include "profile.h"
+#include "trace.h"
+
+/**
+ * resolve a command given its hash
+ * the name is only compared to the candidate (hash collisions)
+ */
+
+static uint8_t resolveCommand( uint16_t hash, const char* name ) {
+	cstr known;
+	uint8_t id;
+
+	switch( hash ) {
+		case str_hash_c( "GET" ): known = "GET"; id = CMD_GET; break;
+		case str_hash_c( "SET" ): known = "SET"; id = CMD_SET; break;
+		case str_hash_c( "INFO" ): known = "INFO"; id = CMD_INFO; break;
+		case str_hash_c( "MGET" ): known = "MGET"; id = CMD_MGET; break;
+		case str_hash_c( "SUBSCRIBE" ): known = "SUBSCRIBE"; id = CMD_SUBSCRIBE; break;
+		case str_hash_c( "UNSUBSCRIBE" ): known = "UNSUBSCRIBE"; id = CMD_UNSUBSCRIBE; break;
+		case str_hash_c( "SYSTEM" ): known = "SYSTEM"; id = CMD_SYSTEM; break;
+		case str_hash_c( "CHANGED" ): known = "CHANGED"; id = CMD_CHANGED; break;
+		case str_hash_c( "WAIT" ): known = "WAIT"; id = CMD_WAIT; break;
+		case str_hash_c( "STOP" ): known = "STOP"; id = CMD_STOP; break;
+		case str_hash_c( "STREAM" ): known = "STREAM"; id = CMD_STREAM; break;
+		case str_hash_c( "CALIB" ): known = "CALIB"; id = CMD_CALIB; break;
+		case str_hash_c( "FACTORY_RESET" ): known = "FACTORY_RESET"; id = CMD_FACTORY_RESET; break;
+		default: return CMD_OTHER;
+	}
+
+	return str_eq( name, known ) ? id : (uint8_t)CMD_OTHER;
+}
 
 /**
  * constructor
+ * tokens are computed from the parts
+ */
+
+Request::Request( char* parts[5], ProtocolSession* session ) {
+	m_command = parts[0];
+	m_property = parts[1] ? parts[1] : "";
+	m_value1 = parts[2] ? parts[2] : "";
+	m_value2 = parts[3] ? parts[3] : "";
+	m_tokens.cmdHash = str_hash( m_command );
+	m_tokens.propHash = str_hash( m_property );
+	m_tokens.attrHash = str_hash( m_value1 );
+	m_tokens.command = resolveCommand( m_tokens.cmdHash, m_command );
+	m_data = NULL;
+	m_dataLen = 0;
+	m_session = session;
+}
+
+/**
+ * constructor, tokens given by the parser
  */
 
-Request::Request( char* parts[5] ) {
+Request::Request( char* parts[5], const RequestTokens& tokens, ProtocolSession* session ) {
 	m_command = parts[0];
 	m_property = parts[1] ? parts[1] : "";
 	m_value1 = parts[2] ? parts[2] : "";
 	m_value2 = parts[3] ? parts[3] : "";
+	m_tokens = tokens;
+	m_data = NULL;
+	m_dataLen = 0;
+	m_session = session;
+}
+
+/**
+ * binary request constructor
+ */
+
+Request::Request( const uint8_t* data, unsigned len, ProtocolSession* session ) {
+	m_command = "";
+	m_property = "";
+	m_value1 = "";
+	m_value2 = "";
+	m_tokens.command = CMD_OTHER;
+	m_tokens.cmdHash = 0;
+	m_tokens.propHash = 0;
+	m_tokens.attrHash = 0;
+	m_data = data;
+	m_dataLen = len;
+	m_session = session;
 }
 
 /**
@@ -53,13 +126,24 @@ cstr Request::getValueStr( int index ) const {
 
 
 
+static uint8_t binaryStatus( const char* code );
+
+/**
+ * frame being written, a response is sent in one stream write
+ * room is kept after the body for the checksum & EOT
+ */
+
+static uint8_t frameBuffer[PROTOCOL_MAX_RESP_LEN + 4];
+
 /**
  * constructor
  */
 
-Response::Response( Stream* stream, bool needCrc ) {
+Response::Response( Stream* stream, bool needCrc, bool binary ) {
 	m_inFrame = false;
+	m_len = 0;
 	m_done = false;
+	m_binary = binary;
 	m_crc = 0;
 	m_stream = stream;
 	m_needCrc = needCrc;
@@ -70,8 +154,13 @@ Response::Response( Stream* stream, bool needCrc ) {
  */
 
 void Response::write( uint8_t t ) {
+	// body is truncated to PROTOCOL_MAX_RESP_LEN, checksum & EOT always fit
+	if( m_inFrame ? m_len >= PROTOCOL_MAX_RESP_LEN : m_len >= sizeof( frameBuffer ) ) {
+		return;
+	}
+
 	m_crc ^= t;
-	m_stream->write( t );
+	frameBuffer[m_len++] = t;
 }
 
 void Response::write( const char* s ) {
@@ -86,9 +175,48 @@ void Response::write( const char* s ) {
  */
 
 void Response::send( const char* property, const char* attribute, const char* status, const char* value ) {
+	_send( "M00", property, attribute, status, value );
+}
+
+/**
+ * send an unsolicited event
+ * same format as a response, but with EVT as code
+ */
+
+void Response::sendEvent( const char* property, const char* attribute, const char* status, const char* value ) {
+	_send( "EVT", property, attribute, status, value );
+}
+
+/**
+ * send a sample of a streamed property (cf. STREAM)
+ * the attribute field is the timestamp (ms)
+ */
+
+void Response::sendSample( const char* property, const char* timestamp, const char* status, const char* value ) {
+	_send( "SMP", property, timestamp, status, value );
+}
+
+/**
+ *
+ */
+
+void Response::_send( const char* code, const char* property, const char* attribute, const char* status, const char* value ) {
+	PROFILE_SCOPE( PROFILE_RESPONSE );
+
+	// no stream: scratch response (cf. MGET), nothing is sent
+	if( !m_stream ) {
+		m_done = true;
+		return;
+	}
+
+	if( m_binary ) {
+		_sendBinaryText( code, status, value );
+		return;
+	}
+
 	_start();
 
-	write( "M00" );
+	write( code );
 	write( PROTOCOL_SEPARATOR );
 
 	write( property );
@@ -107,6 +235,93 @@ void Response::send( const char* property, const char* attribute, const char* st
 	}
 
 	_end();
+	TRACE( TRACE_RESPONSE, binaryStatus( code ), m_len );
+}
+
+/**
+ * binary status of a response code
+ */
+
+static uint8_t binaryStatus( const char* code ) {
+	if( str_eq( code, "EVT" ) ) {
+		return BINARY_STATUS_EVENT;
+	}
+
+	if( str_eq( code, "SMP" ) ) {
+		return BINARY_STATUS_SAMPLE;
+	}
+
+	uint8_t n = str_to_i( code + 1 );
+	return code[0] == 'C' ? ( 0x80 | n ) : n;
+}
+
+/**
+ * text response sent in binary framing (by a message handler)
+ * [status][0xFF][0xFF][state][PROPERTY_TYPE_CSTR][len][value]
+ */
+
+void Response::_sendBinaryText( const char* code, const char* status, const char* value ) {
+	static const char* states[] = { "OK", "BUSY", "ALERT", "IDLE", "NA" };
+
+	uint8_t payload[PROTOCOL_MAX_RESP_LEN];
+	unsigned len = 0;
+
+	payload[len++] = binaryStatus( code );
+	payload[len++] = 0xFF;
+	payload[len++] = 0xFF;
+
+	uint8_t state = 0;
+	for( unsigned i = 0; i < count_of( states ); i++ ) {
+		if( str_eq( states[i], status ) ) {
+			state = i;
+		}
+	}
+
+	payload[len++] = state;
+	payload[len++] = 3; // PROPERTY_TYPE_CSTR
+
+	unsigned vlen = value ? strlen( value ) : 0;
+	if( vlen > sizeof( payload ) - len - 1 ) {
+		vlen = sizeof( payload ) - len - 1;
+	}
+
+	payload[len++] = vlen;
+	memcpy( payload + len, value, vlen );
+	sendBinary( payload, len + vlen );
+}
+
+/**
+ * send a binary frame: payload + crc16, COBS encoded, terminated by 0
+ */
+
+void Response::sendBinary( const uint8_t* payload, unsigned len ) {
+	PROFILE_SCOPE( PROFILE_RESPONSE );
+
+	// no stream: scratch response (cf. MGET), nothing is sent
+	if( !m_stream ) {
+		m_done = true;
+		return;
+	}
+
+	static uint8_t data[PROTOCOL_MAX_RESP_LEN + 2];
+	static uint8_t frame[sizeof( data ) + sizeof( data ) / 254 + 2];
+
+	if( len > PROTOCOL_MAX_RESP_LEN ) {
+		len = PROTOCOL_MAX_RESP_LEN;
+	}
+
+	memcpy( data, payload, len );
+	uint16_t crc = crc16( data, len );
+	data[len++] = crc & 0xff;
+	data[len++] = crc >> 8;
+
+	size_t flen = cobs_encode( data, len, frame );
+	frame[flen++] = PROTOCOL_BINARY_EOT;
+
+	m_stream->write( frame, flen );
+	TRACE( TRACE_RESPONSE, data[0], flen );
+
+	m_done = true;
 }
 
 /**
@@ -114,11 +329,26 @@ void Response::send( const char* property, const char* attribute, const char* st
  */
 
 void Response::sendError( const char* code, const char* description ) {
+	PROFILE_SCOPE( PROFILE_RESPONSE );
+
+	// no stream: scratch response (cf. MGET), nothing is sent
+	if( !m_stream ) {
+		m_done = true;
+		return;
+	}
+
+	if( m_binary ) {
+		uint8_t status = binaryStatus( code );
+		sendBinary( &status, 1 );
+		return;
+	}
+
 	_start();
 	write( code );
 	write( PROTOCOL_SEPARATOR );
 	write( description );
 	_end();
+	TRACE( TRACE_RESPONSE, binaryStatus( code ), m_len );
 }
 
 /**
@@ -127,6 +357,7 @@ void Response::sendError( const char* code, const char* description ) {
 
 void Response::_start() {
 	m_crc = 0;
+	m_len = 0;
 	m_inFrame = true;
 }
 
@@ -144,9 +375,18 @@ void Response::_end() {
 	}
 
 	write( PROTOCOL_EOT );
+	flushFrame();
 	m_done = true;
 }
 
+/**
+ * hand the whole frame to the stream
+ */
+
+void Response::flushFrame() {
+	m_stream->write( frameBuffer, m_len );
+}
+
 /**
  * chack if a response has been sent
  */
@@ -156,75 +396,242 @@ bool Response::isDone( ) const {
 }
 
 /**
- * Finite State Machine state
+ * session idle handler
+ */
+
+static pfnSessionHandler idleHandler = NULL;
+
+void setSessionIdleHandler( pfnSessionHandler handler ) {
+	idleHandler = handler;
+}
+
+/**
+ * loop idle handler
+ */
+
+static pfnIdleHandler loopHandler = NULL;
+
+void setIdleHandler( pfnIdleHandler handler ) {
+	loopHandler = handler;
+}
+
+void processIdle( ) {
+	if( loopHandler ) {
+		loopHandler( );
+	}
+}
+
+/**
+ * constructor
  */
 
-struct State
-{
-	unsigned pos; // current writing position in the buffer
-	long time; // start time of the request
-	uint8_t crc; // current crc
-	bool error; // in error
-	int state; // 0: command, 1: property, 2: attribute, 3: value, 4: checksum
+ProtocolSession::ProtocolSession( Stream* stream ) {
+	static uint8_t count = 0;
 
-	char* parts[5]; // 0: command, 1: property, 2: attribute, 3: value, 4: checksum
-					// parts are pointing inside buf
-					// NULL means not received
+	m_index = count;
 
-	char buf[PROTOCOL_MAXLEN + 1]; // request buffer;
-};
+	if( count < PROTOCOL_MAX_EVENT_SESSIONS ) {
+		m_mask = 1 << count;
+	}
+	else {
+		m_mask = 0;
+	}
+
+	if( count < 15 ) {
+		count++;
+	}
 
-State cState = { 0 };
+	m_binary = false;
+
+	m_stream = stream;
+	m_handler = NULL;
+	m_head = 0;
+	m_count = 0;
+	memset( &m_state, 0, sizeof( m_state ) );
+}
 
 /**
- * send error result
+ * @return the queue slot the parser is filling
  */
 
-void comError( Stream* stream, const char* errCode, const char* desc ) {
-	Response r( stream, true );
-	r.sendError( errCode, desc );
-	cState.pos = 0;
+QueuedRequest* ProtocolSession::current() {
+	return &m_queue[( m_head + m_count ) % PROTOCOL_QUEUE_LEN];
 }
 
 /**
- * call this fonction the most often possible (inside loop for example)
- * take care of that, arduino implementation of serial buffer is by default
- * 16 bytes wide, so if you do not read chars before it's filled, old chars are lost.
- *
- * it will call handler if a message is received
+ * the current slot is complete, append it to the queue
+ * when the queue is full, it is processed
  */
 
-void processMessages( Stream* stream, pfnMsgHandler handler ) {
+void ProtocolSession::commit() {
+	m_state.pos = 0;
+	m_count++;
 
-	long now = millis();
+	if( m_count >= PROTOCOL_QUEUE_LEN ) {
+		flush();
+	}
+}
+
+/**
+ * process all queued requests, in reception order
+ */
+
+void ProtocolSession::flush() {
+	while( m_count ) {
+		dispatch( &m_queue[m_head] );
+
+		m_head = ( m_head + 1 ) % PROTOCOL_QUEUE_LEN;
+		m_count--;
+	}
+}
+
+/**
+ * STOP received after a queued request: the request is cancelled if it is on the
+ * stopped property (all of them for STOP;ALL), it must not run after the STOP
+ * properties given by index (binary frames, handles) cannot be compared here, they are cancelled
+ */
 
-	int input = stream->read();
-	if( input < 0 ) {
-		if( cState.pos && ( now - cState.time ) > PROTOCOL_TIMEOUT_MS ) {
-			// error: restart
-			comError( stream, "C01", "TIMEOUT" );
+static bool isStopped( const QueuedRequest* q, const QueuedRequest* stop ) {
+	cstr target = stop->parts[1] ? stop->parts[1] : "";
+	if( str_eq( target, "ALL" ) || *target == PROPERTY_HANDLE_PREFIX || q->binary ) {
+		return true;
+	}
+
+	cstr prop = q->parts[1] ? q->parts[1] : "";
+	return *prop == PROPERTY_HANDLE_PREFIX || ( q->tokens.propHash == stop->tokens.propHash && strcmp( prop, target ) == 0 );
+}
+
+/**
+ * priority lane: the STOP the parser just completed is processed at once,
+ * before the queued requests, the slot is reused for the next request
+ * the queued requests it cancels are answered M15 in their turn
+ */
+
+void ProtocolSession::dispatchNow() {
+	QueuedRequest* stop = current();
+	m_state.pos = 0;
+
+	for( uint8_t i = 0; i < m_count; i++ ) {
+		QueuedRequest* q = &m_queue[( m_head + i ) % PROTOCOL_QUEUE_LEN];
+		if( !q->errCode && isStopped( q, stop ) ) {
+			q->errCode = "M15";
+			q->errDesc = "STOPPED";
 		}
+	}
 
+	dispatch( stop );
+}
+
+/**
+ * process a single request
+ */
+
+void ProtocolSession::dispatch( QueuedRequest* q ) {
+	if( q->errCode ) {
+		Response r( m_stream, true, q->binary );
+		r.sendError( q->errCode, q->errDesc );
+		return;
+	}
+
+	PROFILE_BEGIN( q->binary ? (uint8_t)PROFILE_ROW_BINARY : q->tokens.command, q->received );
+
+#if TRACE_SIZE
+	const uint32_t start = micros( );
+#endif
+
+	if( q->binary ) {
+		Request msg( (const uint8_t*)q->buf, q->binLen, this );
+		Response rsp( m_stream, true, true );
+
+		if( q->buf[0] == BINARY_OP_ASCII ) {
+			uint8_t ok = 0;
+			rsp.sendBinary( &ok, 1 );
+		}
+		else {
+			m_handler( &msg, &rsp );
+		}
+	}
+	else {
+		Request msg( q->parts, q->tokens, this );
+		Response rsp( m_stream, q->parts[4] ? true : false );
+
+		if( q->tokens.command == CMD_SYSTEM && msg.is( "SYSTEM", "FRAMING" ) ) {
+			processFraming( &msg, &rsp );
+		}
+		else {
+			m_handler( &msg, &rsp );
+		}
+	}
+
+	TRACE_SINCE( TRACE_DISPATCH, q->binary ? 0x80 | q->buf[0] : q->tokens.command, start );
+	PROFILE_END( );
+}
+
+/**
+ * SYSTEM;FRAMING;BINARY switch the session to binary framing
+ * the switch is done by the parser as soon as the request is received
+ * so the host can send binary frames right after it
+ */
+
+void ProtocolSession::processFraming( Request* req, Response* res ) {
+	cstr mode = req->getAttr();
+
+	if( str_eq( mode, "BINARY" ) || str_eq( mode, "ASCII" ) ) {
+		res->send( "FRAMING", mode, "OK", NULL );
+	}
+	else {
+		res->sendError( "M08", "BAD VALUE" );
+	}
+}
+
+/**
+ * queue an error result
+ * it will be sent in order with other responses
+ */
+
+void ProtocolSession::comError( const char* errCode, const char* desc ) {
+	TRACE( TRACE_ERROR, str_to_i( errCode + 1 ), m_state.pos );
+
+	QueuedRequest* q = current();
+	q->errCode = errCode;
+	q->errDesc = desc;
+	commit();
+}
+
+/**
+ * finite state machine, handle a single received char
+ * complete messages are queued
+ */
+
+void ProtocolSession::processByte( uint8_t ch, long now ) {
+
+	if( m_binary ) {
+		processBinaryByte( ch, now );
 		return;
 	}
 
-	// read next input
-	uint8_t ch = (uint8_t)input;
 	if( ch=='\r' ) {	// ignore
 		return;
 	}
 
-	// init cState
-	if( cState.pos == 0 ) {
-		cState.state = 0;
-		cState.time = now;
-		cState.crc = 0;
-		cState.error = false;
-		cState.parts[0] = cState.buf;
-		cState.parts[1] = NULL;
-		cState.parts[2] = NULL;
-		cState.parts[3] = NULL;
-		cState.parts[4] = NULL;
+	QueuedRequest* q = current();
+
+	// init state
+	if( m_state.pos == 0 ) {
+		m_state.state = 0;
+		m_state.time = now;
+		m_state.crc = 0;
+		m_state.error = false;
+		q->errCode = NULL;
+		q->binary = false;
+		q->tokens.cmdHash = STR_HASH_INIT;
+		q->tokens.propHash = STR_HASH_INIT;
+		q->tokens.attrHash = STR_HASH_INIT;
+		q->parts[0] = q->buf;
+		q->parts[1] = NULL;
+		q->parts[2] = NULL;
+		q->parts[3] = NULL;
+		q->parts[4] = NULL;
 	}
 
 	// finite state machine
@@ -233,94 +640,246 @@ void processMessages( Stream* stream, pfnMsgHandler handler ) {
 	if( ch == PROTOCOL_EOT ) {
 
 		// ignore empty lines
-		if( cState.pos == 0 ) {
+		if( m_state.pos == 0 ) {
 			return;
 		}
 
 		// are we in error ?
-		if( cState.error ) {
-			comError( stream, "C04", "OVERFLOW" );
+		if( m_state.error ) {
+			comError( "C04", "OVERFLOW" );
 			return;
 		}
 
 		// close it
-		cState.buf[cState.pos] = 0;
-
-#ifdef DESKTOP_BAREMETAL
-		//printf( "[TRACE] cmd: %s, prop: %s, v1: %s, v2: %s\n", cState.parts[0], cState.parts[1], cState.parts[2], cState.parts[3] );
-		printf( "> %s;%s;%s;%s\n", cState.parts[0], cState.parts[1], cState.parts[2], cState.parts[3] );
-#endif
+		q->buf[m_state.pos] = 0;
+		PROFILE_STAMP( q->received );
 
 		// we must have at least command + property, command cannot be empty
-		if( !cState.state || *cState.parts[0] == 0 ) {
-			comError( stream, "C02", "BAD REQUEST" );
+		if( !m_state.state || *q->parts[0] == 0 ) {
+			comError( "C02", "BAD REQUEST" );
 			return;
 		}
 
 		// do we have a checksum ?
-		if( cState.parts[4] ) {
-			const char* checksum = cState.parts[4];
-			if( checksum[0] != xtoa( ( cState.crc & 0xf0 ) >> 4 ) || checksum[1] != xtoa( cState.crc & 0xf ) ) {
-				comError( stream, "C03", "BAD CHECKSUM" );
+		if( q->parts[4] ) {
+			const char* checksum = q->parts[4];
+			if( checksum[0] != xtoa( ( m_state.crc & 0xf0 ) >> 4 ) || checksum[1] != xtoa( m_state.crc & 0xf ) ) {
+				comError( "C03", "BAD CHECKSUM" );
 				return;
 			}
 		}
 
-		// everything is ok, call message handler
-		Request msg( cState.parts );
-		Response rsp( stream, cState.parts[4] ? true : false );
+		q->tokens.command = resolveCommand( q->tokens.cmdHash, q->parts[0] );
+		TRACE( TRACE_FRAME, q->tokens.command, m_state.pos );
+
+		// framing change, applies to the next received bytes
+		if( q->tokens.command == CMD_SYSTEM && str_eq( q->parts[1], "FRAMING" ) && str_eq( q->parts[2], "BINARY" ) ) {
+			m_binary = true;
+		}
 
-		handler( &msg, &rsp );
+		// STOP is not queued, it is answered before the pending requests
+		if( q->tokens.command == CMD_STOP ) {
+			dispatchNow();
+			return;
+		}
 
-		// restart for a new sequence
-		cState.pos = 0;
+		// everything is ok, queue it & restart for a new sequence
+		commit();
 		return;
 	}
 
 	// we are in error, just wait EOT
-	if( cState.error ) {
+	if( m_state.error ) {
 		return;
 	}
 
-	if( cState.state <= 4 ) {
+	if( m_state.state <= 4 ) {
 		// on a separator, skip to next part
 		if( ch == PROTOCOL_SEPARATOR ) {
 			// in checksum ?
-			if( cState.parts[4] ) {
-				cState.error = true;
+			if( q->parts[4] ) {
+				m_state.error = true;
 				return;
 			}
 
-			cState.buf[cState.pos++] = 0;
-			cState.state++;
-			cState.parts[cState.state] = &cState.buf[cState.pos];
-			cState.crc ^= ch;
+			q->buf[m_state.pos++] = 0;
+			m_state.state++;
+			q->parts[m_state.state] = &q->buf[m_state.pos];
+			m_state.crc ^= ch;
 		}
 		// on the checksum separator
 		else if( ch == PROTOCOL_CHECKSUM_SEPARATOR ) {
 			// first one ?
-			if( cState.parts[4] ) {
-				cState.error = true;
+			if( q->parts[4] ) {
+				m_state.error = true;
 				return;
 			}
 
-			cState.buf[cState.pos++] = 0;
-			cState.parts[4] = &cState.buf[cState.pos];
+			q->buf[m_state.pos++] = 0;
+			q->parts[4] = &q->buf[m_state.pos];
 		}
 		// simple char, add it to the buffer (if space available)
-		else if( cState.pos < PROTOCOL_MAXLEN ) {
-			cState.buf[cState.pos++] = ch;
-			if( !cState.parts[4] ) { // no when checksum mark seen
-				cState.crc ^= ch;
+		else if( m_state.pos < PROTOCOL_MAXLEN ) {
+			q->buf[m_state.pos++] = ch;
+			if( !q->parts[4] ) { // no when checksum mark seen
+				m_state.crc ^= ch;
+
+				// running hashes of command, property & attribute
+				if( m_state.state == 0 ) {
+					q->tokens.cmdHash = str_hash_step( q->tokens.cmdHash, ch );
+				}
+				else if( m_state.state == 1 ) {
+					q->tokens.propHash = str_hash_step( q->tokens.propHash, ch );
+				}
+				else if( m_state.state == 2 ) {
+					q->tokens.attrHash = str_hash_step( q->tokens.attrHash, ch );
+				}
 			}
 		}
 		// overflow
 		else {
-			cState.error = true;
+			m_state.error = true;
 		}
 	}
 	// too many elements
 	else {
-		cState.error = true;
+		m_state.error = true;
 	}
 }
+
+/**
+ * binary framing, handle a single received char
+ * complete frames are decoded and queued
+ */
+
+void ProtocolSession::processBinaryByte( uint8_t ch, long now ) {
+
+	QueuedRequest* q = current();
+
+	// init state
+	if( m_state.pos == 0 ) {
+		m_state.time = now;
+		m_state.error = false;
+		q->errCode = NULL;
+		q->binary = true;
+		q->binLen = 0;
+	}
+
+	// end of frame
+	if( ch == PROTOCOL_BINARY_EOT ) {
+
+		// ignore empty frames
+		if( m_state.pos == 0 ) {
+			return;
+		}
+
+		if( m_state.error ) {
+			comError( "C04", "OVERFLOW" );
+			return;
+		}
+
+		uint8_t* data = (uint8_t*)q->buf;
+		size_t len = cobs_decode( data, m_state.pos, data );
+
+		// at least op + crc
+		if( len < 3 ) {
+			comError( "C02", "BAD REQUEST" );
+			return;
+		}
+
+		len -= 2;
+		if( crc16( data, len ) != ( data[len] | ( data[len + 1] << 8 ) ) ) {
+			comError( "C03", "BAD CHECKSUM" );
+			return;
+		}
+
+		// 0 terminated for text values
+		data[len] = 0;
+		q->binLen = len;
+		PROFILE_STAMP( q->received );
+		TRACE( TRACE_FRAME, 0x80 | data[0], m_state.pos );
+
+		if( data[0] == BINARY_OP_ASCII ) {
+			m_binary = false;
+		}
+
+		commit();
+		return;
+	}
+
+	if( m_state.error ) {
+		return;
+	}
+
+	if( m_state.pos < PROTOCOL_MAXLEN ) {
+		q->buf[m_state.pos++] = ch;
+	}
+	else {
+		m_state.error = true;
+	}
+}
+
+/**
+ * read everything pending on the session stream by chunks and parse it,
+ * handler is called for each complete message found, responses are sent
+ * in the order of the requests.
+ */
+
+void ProtocolSession::process( pfnMsgHandler handler ) {
+
+	long now = millis();
+	m_handler = handler;
+	TRACE_SESSION( m_index );
+	bool received = false;
+
+	uint8_t chunk[PROTOCOL_CHUNK_LEN];
+	int avail;
+
+	while( ( avail = m_stream->available() ) > 0 ) {
+		size_t len = m_stream->readBytes( (char*)chunk, (size_t)avail < sizeof( chunk ) ? avail : sizeof( chunk ) );
+		if( !len ) {
+			break;
+		}
+
+		for( size_t i = 0; i < len; i++ ) {
+			processByte( chunk[i], now );
+		}
+
+		received = true;
+	}
+
+	if( !received && m_state.pos && ( now - m_state.time ) > PROTOCOL_TIMEOUT_MS ) {
+		// error: restart
+		comError( "C01", "TIMEOUT" );
+	}
+
+	flush();
+
+	// responses are complete, we can send events
+	if( idleHandler ) {
+		idleHandler( this );
+	}
+}
+
+/**
+ * call this fonction the most often possible (inside loop for example)
+ * take care of that, arduino implementation of serial buffer is by default
+ * 16 bytes wide, so if you do not read chars before it's filled, old chars are lost.
+ *
+ * sessions are independent, to serve several links, call it for each session
+ * in turn from the same loop, then call processIdle once.
+ */
+
+void processMessages( ProtocolSession* session, pfnMsgHandler handler ) {
+	session->process( handler );
+}
+
+/**
+ * single link version, the session is bound to the stream on first call
+ */
+
+void processMessages( Stream* stream, pfnMsgHandler handler ) {
+	static ProtocolSession session( stream );
+	processMessages( &session, handler );
+	processIdle( );
+}
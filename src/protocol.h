@@ -15,12 +15,28 @@
 // max length of a received message (end of line included)
 #define PROTOCOL_MAXLEN 150
 
+// size of the chunk read from the stream in a single call
+#define PROTOCOL_CHUNK_LEN 64
+
+// count of requests a session can receive before answering (pipelining window)
+// each one needs a PROTOCOL_MAXLEN buffer
+#ifndef PROTOCOL_QUEUE_LEN
+#	if defined( __AVR__ )
+#		define PROTOCOL_QUEUE_LEN 1
+#	else
+#		define PROTOCOL_QUEUE_LEN 4
+#	endif
+#endif
+
 // max length of a response message
 #define PROTOCOL_MAX_RESP_LEN 255
 
 // elements separator
 #define PROTOCOL_SEPARATOR ';'
 
+// list items separator (inside an element)
+#define PROTOCOL_LIST_SEPARATOR ','
+
 // timeout
 #define PROTOCOL_TIMEOUT_MS 1000
 
@@ -30,14 +46,72 @@
 // end of message
 #define PROTOCOL_EOT '\n'
 
+// binary framing (see SYSTEM;FRAMING;BINARY)
+// frames are COBS encoded and ends with 0, last 2 bytes are a crc16
+#define PROTOCOL_BINARY_EOT 0x00
+
+#define BINARY_OP_GET 0x01 // [prop][attr]
+#define BINARY_OP_SET 0x02 // [prop][attr][value]
+#define BINARY_OP_MGET 0x03 // [prop][attr]...
+#define BINARY_OP_ASCII 0x7F // back to ascii framing
+
+#define BINARY_STATUS_EVENT 0xFF // status of an event, Mxx errors are xx, Cxx errors are 0x80 | xx
+#define BINARY_STATUS_SAMPLE 0xFE // status of a STREAM sample
+
+// max count of sessions that can receive events
+#define PROTOCOL_MAX_EVENT_SESSIONS 8
+
 // forward references
 class Request;
 class Response;
 class WorkingBuffer;
+class ProtocolSession;
+
+/**
+ * well known commands, resolved by the parser
+ */
+
+enum CommandId
+{
+	CMD_OTHER = 0, // application command (COMMAND_START)
+	CMD_GET,
+	CMD_SET,
+	CMD_INFO,
+	CMD_MGET,
+	CMD_SUBSCRIBE,
+	CMD_UNSUBSCRIBE,
+	CMD_SYSTEM,
+	CMD_CHANGED,
+	CMD_WAIT,
+	CMD_STOP, // dispatched as soon as received (cf. ProtocolSession::dispatchNow)
+	CMD_STREAM,
+	CMD_CALIB,
+	CMD_FACTORY_RESET,
+	CMD_COUNT, // count of well known commands
+};
+
+/**
+ * tokens computed while the request is received
+ * so the dispatch does not need to scan the strings again
+ */
+
+struct RequestTokens
+{
+	uint8_t command; // CMD_xxx
+	uint16_t cmdHash; // str_hash of the command
+	uint16_t propHash; // str_hash of the property
+	uint16_t attrHash; // str_hash of the attribute
+};
 
 // prototype of a message handler
 typedef void ( *pfnMsgHandler )( Request*, Response* );
 
+// prototype of a session handler
+typedef void ( *pfnSessionHandler )( ProtocolSession* );
+
+// prototype of the loop idle handler
+typedef void ( *pfnIdleHandler )( );
+
 /**
  * Request class
  */
@@ -51,9 +125,22 @@ private:
 	const char* m_value1;
 	const char* m_value2;
 
+	RequestTokens m_tokens; // resolved command & hashes
+
+	const uint8_t* m_data; // binary request, NULL for text requests
+	unsigned m_dataLen; // binary request length
+
+	ProtocolSession* m_session; // session the request comes from
+
 public:
 	// parts must keep alive during the life of the Request object
-	Request( char* parts[5] );
+	Request( char* parts[5], ProtocolSession* session = NULL );
+
+	// parts already tokenized by the parser
+	Request( char* parts[5], const RequestTokens& tokens, ProtocolSession* session );
+
+	// binary request, data must keep alive during the life of the Request object
+	Request( const uint8_t* data, unsigned len, ProtocolSession* session );
 
 	//
 	bool is( const char* cmd ) const;
@@ -64,6 +151,22 @@ public:
 		return m_command;
 	}
 
+	uint8_t getCommandId() const {
+		return m_tokens.command;
+	}
+
+	uint16_t getCommandHash() const {
+		return m_tokens.cmdHash;
+	}
+
+	uint16_t getPropertyHash() const {
+		return m_tokens.propHash;
+	}
+
+	uint16_t getAttrHash() const {
+		return m_tokens.attrHash;
+	}
+
 	const char* getProperty() const {
 		return m_property;
 	}
@@ -74,6 +177,22 @@ public:
 
 	Value getValue( int index ) const;
 	cstr getValueStr( int index ) const;
+
+	ProtocolSession* getSession() const {
+		return m_session;
+	}
+
+	bool isBinary() const {
+		return m_data != NULL;
+	}
+
+	const uint8_t* getData() const {
+		return m_data;
+	}
+
+	unsigned getDataLength() const {
+		return m_dataLen;
+	}
 };
 
 /**
@@ -89,29 +208,162 @@ private:
 	bool m_inFrame;	// we are in frame (compute crc on written elements)
 	bool m_needCrc; // do we need to send crc
 	bool m_done;	// a response was sent
+	bool m_binary;	// binary framing
+	unsigned m_len;	// bytes in the frame buffer (kept once the frame is sent)
 
 public:
-	explicit Response( Stream* stream, bool needCrc );
+	// with a NULL stream, responses are dropped (the request is still answered, cf. isDone)
+	explicit Response( Stream* stream, bool needCrc, bool binary = false );
 
 	void send( const char* property, const char* attribute, const char* status, const char* value );
 	void sendError( const char* code, const char* desc );
+	void sendEvent( const char* property, const char* attribute, const char* status, const char* value );
+	void sendSample( const char* property, const char* timestamp, const char* status, const char* value );
+
+	// binary framing only, payload is sent with crc16 & COBS encoded
+	void sendBinary( const uint8_t* payload, unsigned len );
 
 	bool isDone( ) const;
 
+	bool isBinary( ) const {
+		return m_binary;
+	}
+
 private:
 	// write implementation
 	void write( uint8_t t );
 	void write( const char* s );
+	void flushFrame();
 
 	void _start();
 	void _end();
+	void _send( const char* code, const char* property, const char* attribute, const char* status, const char* value );
+	void _sendBinaryText( const char* code, const char* status, const char* value );
+};
+
+/**
+ * Finite State Machine state
+ */
+
+struct State
+{
+	unsigned pos; // current writing position in the buffer
+	long time; // start time of the request
+	uint8_t crc; // current crc
+	bool error; // in error
+	int state; // 0: command, 1: property, 2: attribute, 3: value, 4: checksum
 };
 
+/**
+ * a received request waiting to be processed
+ */
+
+struct QueuedRequest
+{
+	cstr errCode; // error to send instead of processing (communication error, M15 cancelled by STOP), NULL if the request is valid
+	cstr errDesc; // error description
+
+	char* parts[5]; // 0: command, 1: property, 2: attribute, 3: value, 4: checksum
+					// parts are pointing inside buf
+					// NULL means not received
+
+	RequestTokens tokens; // computed while receiving
+
+	bool binary; // received in binary framing
+	uint8_t binLen; // binary request: length of the decoded data in buf
+
+#ifdef USIS_PROFILE
+	uint32_t received; // micros() when the last byte was parsed
+#endif
+
+	char buf[PROTOCOL_MAXLEN + 1]; // request buffer;
+};
+
+/**
+ * ProtocolSession class
+ * a session is bound to a stream and holds its own parser state,
+ * so several links can be served at the same time
+ */
+
+class ProtocolSession {
+
+private:
+	Stream* m_stream; // stream we are reading from & writing to
+	pfnMsgHandler m_handler; // handler called for each request
+	State m_state; // parser state
+
+	QueuedRequest m_queue[PROTOCOL_QUEUE_LEN]; // received requests (ring)
+	uint8_t m_head; // first queued request
+	uint8_t m_count; // count of queued requests
+
+	uint8_t m_mask; // session bit for events, 0 if none available
+	uint8_t m_index; // session number (order of creation), saturated to 15
+	bool m_binary; // binary framing
+
+public:
+	explicit ProtocolSession( Stream* stream );
+
+	Stream* getStream() const {
+		return m_stream;
+	}
+
+	uint8_t getMask() const {
+		return m_mask;
+	}
+
+	bool isBinary() const {
+		return m_binary;
+	}
+
+	void process( pfnMsgHandler handler );
+
+private:
+	void processByte( uint8_t ch, long now );
+	void processBinaryByte( uint8_t ch, long now );
+	void comError( const char* errCode, const char* desc );
+
+	QueuedRequest* current();
+	void commit();
+	void flush();
+	void dispatch( QueuedRequest* q );
+	void dispatchNow();
+
+	void processFraming( Request* req, Response* res );
+};
+
+/**
+ * set the function called for each session after received messages are processed
+ * (used to send events)
+ */
+
+void setSessionIdleHandler( pfnSessionHandler handler );
+
+/**
+ * set the function called once per loop pass, after all sessions are processed
+ * (work shared by the sessions: tasks, histories...)
+ */
+
+void setIdleHandler( pfnIdleHandler handler );
+
 /**
  * process message
  * call this as often you can
  */
 
+void processMessages( ProtocolSession* session, pfnMsgHandler handler );
+
+/**
+ * work shared by the sessions (tasks, coroutines, histories...)
+ * with several sessions, call it once per loop after processMessages on each of them
+ */
+
+void processIdle( );
+
+/**
+ * process message on a single link, then the shared work (cf. processIdle)
+ * the first stream given is used for the life of the application
+ */
+
 void processMessages( Stream* serial, pfnMsgHandler handler );
 
 #endif
\ No newline at end of file
@@ -0,0 +1,192 @@
+/**
+ * @file scheduler.cpp
+ * @desc Usis cooperative tasks
+ *
+ * @author Etienne Cochard ecochard@r-libre.fr
+ * @version 1.0
+ **/
+
+#include "scheduler.h"
+
+/**
+ * scheduled tasks
+ */
+
+static Task* tasks = NULL;
+
+// next task to run when the last pass ran out of time
+static Task* resume = NULL;
+
+/**
+ * list walks in progress (runTasks, cancelPropertyTasks, nested by the task steps)
+ * a step may cancel or restart any task, the next task to visit is kept up to date by unlinkTask
+ */
+
+struct TaskCursor
+{
+	Task* next; // next task to visit
+	TaskCursor* up; // enclosing walk
+};
+
+static TaskCursor* cursors = NULL;
+
+/**
+ * remove the task from the list
+ */
+
+static void unlinkTask( Task* task ) {
+	Task** pt = &tasks;
+	while( *pt ) {
+		if( *pt == task ) {
+			*pt = task->next;
+			break;
+		}
+
+		pt = &( *pt )->next;
+	}
+
+	if( resume == task ) {
+		resume = task->next;
+	}
+
+	for( TaskCursor* c = cursors; c; c = c->up ) {
+		if( c->next == task ) {
+			c->next = task->next;
+		}
+	}
+
+	task->active = false;
+	task->next = NULL;
+}
+
+/**
+ * task is over, the property gets its final state
+ */
+
+static void endTask( Task* task, uint8_t state ) {
+	unlinkTask( task );
+
+	if( task->prop ) {
+		setPropertyState( task->prop, state );
+	}
+}
+
+/**
+ * start a task
+ */
+
+void startTask( Task* task, pfnTask run, rawProperty* prop, uint32_t period, uint32_t timeout, void* data ) {
+	if( task->active ) {
+		unlinkTask( task );
+	}
+
+	const long now = millis( );
+
+	task->run = run;
+	task->prop = prop;
+	task->data = data;
+	task->period = period;
+	task->due = now;
+	task->deadline = now + timeout;
+	task->timeout = timeout != 0;
+	task->active = true;
+
+	// appended, tasks run in start order
+	task->next = NULL;
+	Task** pt = &tasks;
+	while( *pt ) {
+		pt = &( *pt )->next;
+	}
+
+	*pt = task;
+
+	if( prop ) {
+		setPropertyState( prop, PROPERTY_STATE_BUSY );
+	}
+}
+
+/**
+ * cancel a task
+ */
+
+void cancelTask( Task* task, uint8_t state ) {
+	if( !task->active ) {
+		return;
+	}
+
+	task->run( TaskStop, task );
+	endTask( task, state );
+}
+
+/**
+ * cancel the tasks of a property
+ */
+
+void cancelPropertyTasks( rawProperty* prop ) {
+	TaskCursor cursor = { NULL, cursors };
+	cursors = &cursor;
+
+	Task* t = tasks;
+	while( t ) {
+		cursor.next = t->next;
+		if( !prop || t->prop == prop ) {
+			cancelTask( t );
+		}
+
+		t = cursor.next;
+	}
+
+	cursors = cursor.up;
+}
+
+/**
+ * run the tasks due, until the time budget is spent
+ */
+
+void runTasks( ) {
+	if( !tasks ) {
+		return;
+	}
+
+	const long now = millis( );
+	const unsigned long start = micros( );
+
+	Task* t = resume ? resume : tasks;
+	resume = NULL;
+
+	TaskCursor cursor = { NULL, cursors };
+	cursors = &cursor;
+
+	while( t ) {
+		cursor.next = t->next;
+
+		if( t->timeout && (long)( now - t->deadline ) >= 0 ) {
+			t->run( TaskTimeout, t );
+			endTask( t, PROPERTY_STATE_ALERT );
+		}
+		else if( (long)( now - t->due ) >= 0 ) {
+			t->due += t->period;
+			if( (long)( now - t->due ) >= 0 ) {
+				t->due = now + t->period;
+			}
+
+			TaskResult rc = t->run( TaskRun, t );
+			if( rc != TaskContinue && t->active ) {
+				endTask( t, rc == TaskDone ? PROPERTY_STATE_READY : PROPERTY_STATE_ALERT );
+			}
+		}
+
+		// the step may have cancelled or restarted the following task
+		Task* next = cursor.next;
+
+		// out of time, let the loop read the input
+		if( next && (unsigned long)micros( ) - start >= SCHEDULER_BUDGET_US ) {
+			resume = next;
+			break;
+		}
+
+		t = next;
+	}
+
+	cursors = cursor.up;
+}
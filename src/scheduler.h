@@ -0,0 +1,99 @@
+/**
+ * @file scheduler.h
+ * @desc Usis cooperative tasks
+ *
+ * @author Etienne Cochard ecochard@r-libre.fr
+ * @version 1.0
+ **/
+
+#ifndef __USIS_SCHEDULER_H
+#define __USIS_SCHEDULER_H
+
+#include "properties.h"
+
+// time given to the tasks on each loop pass, tasks not run are resumed on the next pass
+// so the serial input is read at least every SCHEDULER_BUDGET_US + one task step
+#ifndef SCHEDULER_BUDGET_US
+#	define SCHEDULER_BUDGET_US 1000
+#endif
+
+struct Task;
+
+/**
+ * messages received by a task
+ */
+
+enum TaskMsg
+{
+	TaskRun = 1, // periodic step
+	TaskStop = 2, // cancelled (STOP on the property or cancelTask), last call
+	TaskTimeout = 3, // deadline reached, last call
+};
+
+/**
+ * result of a task step
+ */
+
+enum TaskResult
+{
+	TaskContinue = 0, // call again after the period
+	TaskDone = 1, // finished, the property goes READY
+	TaskFailed = 2, // finished, the property goes ALERT
+};
+
+// prototype of a task step, must return quickly (no busy wait)
+typedef TaskResult ( *pfnTask )( TaskMsg msg, Task* task );
+
+/**
+ * a task, storage is given by the application (static)
+ */
+
+struct Task
+{
+	pfnTask run; // step function
+	rawProperty* prop; // property driven by the task (BUSY while running), may be NULL
+	void* data; // application data
+	uint32_t period; // ms between two steps, 0 for each loop pass
+	long due; // millis() of the next step
+	long deadline; // millis() of the timeout
+	bool timeout; // deadline is set
+	bool active; // task is scheduled
+	Task* next; // next scheduled task
+};
+
+/**
+ * start a task, the property (if any) goes BUSY
+ * a task already running is restarted
+ * @param task - the task storage
+ * @param run - step function
+ * @param prop - property driven by the task, cancelled by STOP on it, may be NULL
+ * @param period - ms between two steps
+ * @param timeout - max duration in ms, 0 for none
+ *
+ * @example
+ * 	static Task move;
+ * 	startTask( &move, moveStep, prop, 10, 30000 );
+ */
+
+void startTask( Task* task, pfnTask run, rawProperty* prop, uint32_t period, uint32_t timeout = 0, void* data = NULL );
+
+/**
+ * cancel a task, it receives TaskStop and the property goes to the given state
+ */
+
+void cancelTask( Task* task, uint8_t state = PROPERTY_STATE_READY );
+
+/**
+ * cancel the tasks driving a property, NULL for all tasks (STOP;ALL)
+ * tasks started by a TaskStop are visited as well: a task must not restart itself on TaskStop
+ */
+
+void cancelPropertyTasks( rawProperty* prop );
+
+/**
+ * run the tasks due, called once per loop (cf. processIdle)
+ */
+
+void runTasks( );
+
+#endif
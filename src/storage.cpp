@@ -0,0 +1,441 @@
+/**
+ * @file storage.cpp
+ * @desc Usis attributes persistence
+ *
+ * @author Etienne Cochard ecochard@r-libre.fr
+ * @version 1.0
+ **/
+
+#include "storage.h"
+#include "introspection.h"
+
+/**
+ * sector: [header][record][record]...[0xFF...]
+ * header: 'U' 'S' [seq:2] [schema:4]
+ * record: [kind] [property index] [attribute index] [value:4] [check]
+ * a record not fully written (power loss) has a bad check and is skipped
+ */
+
+#define STORAGE_RECORD_SIZE 8
+#define STORAGE_MAGIC0 'U'
+#define STORAGE_MAGIC1 'S'
+
+enum RecordKind
+{
+	RecValue = 1, // attribute value
+	RecReset = 2, // factory reset of the property
+	RecEnd = 0xFF, // erased, end of the log
+};
+
+static Storage* storage = NULL;
+static unsigned sector = 0; // current sector
+static uint32_t pos = 0; // write position in the sector, 0 when no sector is formatted
+static uint16_t seq = 0; // sequence of the current sector, the highest is the current one
+
+/**
+ * little endian helpers
+ */
+
+static void putLe32( uint8_t* p, uint32_t v ) {
+	p[0] = v & 0xff;
+	p[1] = ( v >> 8 ) & 0xff;
+	p[2] = ( v >> 16 ) & 0xff;
+	p[3] = ( v >> 24 ) & 0xff;
+}
+
+static uint32_t getLe32( const uint8_t* p ) {
+	return (uint32_t)p[0] | ( (uint32_t)p[1] << 8 ) | ( (uint32_t)p[2] << 16 ) | ( (uint32_t)p[3] << 24 );
+}
+
+static uint8_t recordCheck( const uint8_t* rec ) {
+	uint8_t sum = 0;
+	for( unsigned i = 0; i < STORAGE_RECORD_SIZE - 1; i++ ) {
+		sum += rec[i];
+	}
+
+	return ~sum;
+}
+
+/**
+ * index of the property without commands (cf. getPropertyByIndex), -1 if not persisted
+ */
+
+static int propIndex( rawProperty* prop ) {
+	int idx = 0;
+	for( rawProperty* p = properties; p; p = p->next ) {
+		if( p == prop ) {
+			return isCommand( p ) || idx >= RecEnd ? -1 : idx;
+		}
+
+		if( !isCommand( p ) ) {
+			idx++;
+		}
+	}
+
+	return -1;
+}
+
+static bool isPersisted( rawAttribute* a ) {
+	const uint8_t type = a->value.attrs & PROPERTY_TYPE_MASK;
+	return type == PROPERTY_TYPE_INT || type == PROPERTY_TYPE_FLOAT || type == PROPERTY_TYPE_ENUM;
+}
+
+/**
+ * value as stored, ints are stored on 32 bits (int is 16 bits on AVR)
+ */
+
+static uint32_t valueBits( const rawValue& v ) {
+	if( ( v.attrs & PROPERTY_TYPE_MASK ) == PROPERTY_TYPE_FLOAT ) {
+		uint32_t bits;
+		memcpy( &bits, &v.fval, sizeof( bits ) );
+		return bits;
+	}
+
+	return (uint32_t)(int32_t)v.ival;
+}
+
+static bool isDefault( rawAttribute* a ) {
+	rawValue init;
+	init.attrs = a->value.attrs;
+	flash_read( &init.sval, &a->desc->init, sizeof( a->desc->init ) );
+	return valueBits( init ) == valueBits( a->value );
+}
+
+/**
+ * write a record at the current position
+ * @return false if the sector is full
+ */
+
+static bool writeRecord( uint8_t kind, uint8_t prop, uint8_t attr, uint32_t value ) {
+	if( pos + STORAGE_RECORD_SIZE > storage->sectorSize( ) ) {
+		return false;
+	}
+
+	uint8_t rec[STORAGE_RECORD_SIZE];
+	rec[0] = kind;
+	rec[1] = prop;
+	rec[2] = attr;
+	putLe32( rec + 3, value );
+	rec[7] = recordCheck( rec );
+
+	storage->write( (uint32_t)sector * storage->sectorSize( ) + pos, rec, STORAGE_RECORD_SIZE );
+	pos += STORAGE_RECORD_SIZE;
+	return true;
+}
+
+/**
+ * count of records of a full snapshot (all persisted attributes)
+ */
+
+static unsigned snapshotRecords( ) {
+	unsigned count = 0;
+	for( int i = 0; i < RecEnd; i++ ) {
+		rawProperty* p = getPropertyByIndex( i, true );
+		if( !p ) {
+			break;
+		}
+
+		for( rawAttribute* a = p->attrs; a; a = a->next ) {
+			if( isPersisted( a ) ) {
+				count++;
+			}
+		}
+	}
+
+	return count;
+}
+
+/**
+ * start the next sector with the attributes that are not at their default value
+ * the previous sector stays valid until the new header is written
+ * (cannot overflow, checked by beginStorage: the storage is dropped if it does)
+ */
+
+static void rotate( ) {
+	const unsigned next = pos ? ( sector + 1 ) % storage->sectorCount( ) : sector;
+	storage->erase( next );
+
+	sector = next;
+	pos = STORAGE_RECORD_SIZE;
+	seq++;
+
+	for( int i = 0;; i++ ) {
+		rawProperty* p = getPropertyByIndex( i, true );
+		if( !p || i >= RecEnd ) {
+			break;
+		}
+
+		uint8_t j = 0;
+		for( rawAttribute* a = p->attrs; a; a = a->next, j++ ) {
+			if( isPersisted( a ) && !isDefault( a ) && !writeRecord( RecValue, i, j, valueBits( a->value ) ) ) {
+				// incomplete snapshot, no header: the previous sector stays the current one
+				storage = NULL;
+				return;
+			}
+		}
+	}
+
+	// header last, the sector is used once complete
+	uint8_t header[STORAGE_RECORD_SIZE];
+	header[0] = STORAGE_MAGIC0;
+	header[1] = STORAGE_MAGIC1;
+	header[2] = seq & 0xff;
+	header[3] = seq >> 8;
+	putLe32( header + 4, getSchemaHash( ) );
+	storage->write( (uint32_t)sector * storage->sectorSize( ), header, sizeof( header ) );
+}
+
+/**
+ * append a record, the current values are rewritten in the next sector when full
+ */
+
+static void appendRecord( uint8_t kind, uint8_t prop, uint8_t attr, uint32_t value ) {
+	if( !pos || !writeRecord( kind, prop, attr, value ) ) {
+		// the record is part of the snapshot
+		rotate( );
+	}
+}
+
+/**
+ * apply a record read from the log
+ */
+
+static bool applyRecord( const uint8_t* rec ) {
+	rawProperty* p = getPropertyByIndex( rec[1], true );
+	if( !p ) {
+		return false;
+	}
+
+	switch( rec[0] ) {
+		case RecValue: {
+			rawAttribute* a = getAttributeByIndex( p, rec[2] );
+			if( !a || !isPersisted( a ) ) {
+				return false;
+			}
+
+			const uint32_t bits = getLe32( rec + 3 );
+			if( ( a->value.attrs & PROPERTY_TYPE_MASK ) == PROPERTY_TYPE_FLOAT ) {
+				float f;
+				memcpy( &f, &bits, sizeof( f ) );
+				forceAttr( a, f );
+			}
+			else {
+				forceAttr( a, (int)(int32_t)bits );
+			}
+
+			return true;
+		}
+
+		case RecReset: {
+			for( rawAttribute* a = p->attrs; a; a = a->next ) {
+				resetAttr( a );
+			}
+
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/**
+ * find the current sector & replay it
+ */
+
+int beginStorage( Storage* s ) {
+	storage = NULL;
+	pos = 0;
+	seq = 0;
+	sector = 0;
+
+	const unsigned size = s->sectorSize( );
+	if( ( snapshotRecords( ) + 1 ) * STORAGE_RECORD_SIZE > size ) {
+		return -1;
+	}
+
+	storage = s;
+
+	const uint32_t schema = getSchemaHash( );
+	bool found = false;
+
+	for( unsigned i = 0; i < storage->sectorCount( ); i++ ) {
+		uint8_t header[STORAGE_RECORD_SIZE];
+		storage->read( (uint32_t)i * size, header, sizeof( header ) );
+
+		if( header[0] != STORAGE_MAGIC0 || header[1] != STORAGE_MAGIC1 || getLe32( header + 4 ) != schema ) {
+			continue;
+		}
+
+		const uint16_t hseq = header[2] | ( header[3] << 8 );
+		if( !found || (int16_t)( hseq - seq ) > 0 ) {
+			found = true;
+			sector = i;
+			seq = hseq;
+		}
+	}
+
+	if( !found ) {
+		return 0;
+	}
+
+	// records are read by blocks
+	static uint8_t block[STORAGE_RECORD_SIZE * 16];
+	unsigned applied = 0;
+
+	pos = STORAGE_RECORD_SIZE;
+	while( pos + STORAGE_RECORD_SIZE <= size ) {
+		unsigned len = size - pos < sizeof( block ) ? size - pos : sizeof( block );
+		len -= len % STORAGE_RECORD_SIZE;
+		storage->read( (uint32_t)sector * size + pos, block, len );
+
+		for( unsigned i = 0; i < len; i += STORAGE_RECORD_SIZE ) {
+			const uint8_t* rec = block + i;
+			if( rec[0] == RecEnd ) {
+				return applied;
+			}
+
+			if( rec[7] == recordCheck( rec ) && applyRecord( rec ) ) {
+				applied++;
+			}
+
+			pos += STORAGE_RECORD_SIZE;
+		}
+	}
+
+	return applied;
+}
+
+/**
+ * append the attribute value to the log
+ */
+
+void saveAttribute( rawProperty* prop, rawAttribute* attr ) {
+	if( !storage || !isPersisted( attr ) ) {
+		return;
+	}
+
+	const int idx = propIndex( prop );
+	if( idx < 0 ) {
+		return;
+	}
+
+	uint8_t j = 0;
+	for( rawAttribute* a = prop->attrs; a && a != attr; a = a->next ) {
+		j++;
+	}
+
+	appendRecord( RecValue, idx, j, valueBits( attr->value ) );
+}
+
+/**
+ * record a factory reset, all properties reset start a new sector
+ */
+
+void saveFactoryReset( rawProperty* prop ) {
+	if( !storage ) {
+		return;
+	}
+
+	if( !prop ) {
+		rotate( );
+		return;
+	}
+
+	const int idx = propIndex( prop );
+	if( idx >= 0 ) {
+		appendRecord( RecReset, idx, 0, 0 );
+	}
+}
+
+#if defined( DESKTOPBM )
+
+/**
+ * file backed storage
+ */
+
+FileStorage::FileStorage( const char* path, unsigned sectorSize, unsigned sectorCount ) {
+	size = sectorSize;
+	count = sectorCount;
+
+	file = fopen( path, "r+b" );
+	if( !file ) {
+		file = fopen( path, "w+b" );
+		for( unsigned i = 0; file && i < count; i++ ) {
+			erase( i );
+		}
+	}
+}
+
+FileStorage::~FileStorage( ) {
+	if( file ) {
+		fclose( file );
+	}
+}
+
+unsigned FileStorage::sectorSize( ) {
+	return size;
+}
+
+unsigned FileStorage::sectorCount( ) {
+	return count;
+}
+
+void FileStorage::read( uint32_t addr, uint8_t* buffer, unsigned len ) {
+	memset( buffer, 0xFF, len );
+	if( file ) {
+		fseek( file, addr, SEEK_SET );
+		fread( buffer, 1, len, file );
+	}
+}
+
+/**
+ * like flash, bits can only be cleared
+ */
+
+bool FileStorage::write( uint32_t addr, const uint8_t* buffer, unsigned len ) {
+	if( !file ) {
+		return false;
+	}
+
+	uint8_t cur[64];
+	while( len ) {
+		unsigned n = len < sizeof( cur ) ? len : sizeof( cur );
+		read( addr, cur, n );
+
+		for( unsigned i = 0; i < n; i++ ) {
+			cur[i] &= buffer[i];
+		}
+
+		fseek( file, addr, SEEK_SET );
+		if( fwrite( cur, 1, n, file ) != n ) {
+			return false;
+		}
+
+		addr += n;
+		buffer += n;
+		len -= n;
+	}
+
+	fflush( file );
+	return true;
+}
+
+bool FileStorage::erase( unsigned sector ) {
+	if( !file ) {
+		return false;
+	}
+
+	uint8_t ff[64];
+	memset( ff, 0xFF, sizeof( ff ) );
+
+	fseek( file, (long)sector * size, SEEK_SET );
+	for( unsigned done = 0; done < size; done += sizeof( ff ) ) {
+		unsigned n = size - done < sizeof( ff ) ? size - done : sizeof( ff );
+		fwrite( ff, 1, n, file );
+	}
+
+	fflush( file );
+	return true;
+}
+
+#endif
@@ -0,0 +1,95 @@
+/**
+ * @file storage.h
+ * @desc Usis attributes persistence
+ *
+ * @author Etienne Cochard ecochard@r-libre.fr
+ * @version 1.0
+ **/
+
+#ifndef __USIS_STORAGE_H
+#define __USIS_STORAGE_H
+
+#include "properties.h"
+
+/**
+ * non volatile memory (flash, EEPROM, file...) seen as sectors
+ * like NOR flash, a write can only clear bits: bytes are written once after the sector erase
+ */
+
+class Storage {
+public:
+	// size of a sector in bytes (erase unit)
+	virtual unsigned sectorSize( ) = 0;
+
+	// count of sectors, at least 2
+	virtual unsigned sectorCount( ) = 0;
+
+	virtual void read( uint32_t addr, uint8_t* buffer, unsigned len ) = 0;
+	virtual bool write( uint32_t addr, const uint8_t* buffer, unsigned len ) = 0;
+
+	// set all bytes of the sector to 0xFF
+	virtual bool erase( unsigned sector ) = 0;
+};
+
+/**
+ * persistence is a log of records appended to the current sector
+ * when it is full, the next sector is erased and receives the attributes
+ * different from their defaults, so sectors are used in turn (wear levelling)
+ *
+ * persisted attributes are the INT, FLOAT & ENUM ones of non command properties,
+ * changed by SET, CALIB or saveAttribute
+ * the log is ignored when the properties definitions change (cf. getSchemaHash)
+ */
+
+/**
+ * read the log and restore the attributes, called in init() once the properties are defined
+ * a sector must hold the header and one record per persisted attribute (8 bytes each),
+ * else the storage is refused and nothing is persisted
+ * @return the count of records applied, -1 if the sectors are too small
+ *
+ * @example
+ * 	static FileStorage storage( "usis.dat", 4096, 4 );
+ * 	beginStorage( &storage );
+ */
+
+int beginStorage( Storage* storage );
+
+/**
+ * append the attribute value to the log
+ * does nothing without storage or when the attribute cannot be persisted
+ */
+
+void saveAttribute( rawProperty* prop, rawAttribute* attr );
+
+/**
+ * record a factory reset of the property, NULL for all of them
+ */
+
+void saveFactoryReset( rawProperty* prop );
+
+#if defined( DESKTOPBM )
+
+/**
+ * file backed storage, for tests on desktop
+ * the file is created (erased) if it does not exist
+ */
+
+class FileStorage : public Storage {
+	FILE* file;
+	unsigned size; // sector size
+	unsigned count; // sector count
+
+public:
+	FileStorage( const char* path, unsigned sectorSize, unsigned sectorCount );
+	~FileStorage( );
+
+	virtual unsigned sectorSize( ) override;
+	virtual unsigned sectorCount( ) override;
+	virtual void read( uint32_t addr, uint8_t* buffer, unsigned len ) override;
+	virtual bool write( uint32_t addr, const uint8_t* buffer, unsigned len ) override;
+	virtual bool erase( unsigned sector ) override;
+};
+
+#endif
+
+#endif
@@ -22,6 +22,23 @@ bool str_eq( const char* s1, const char* s2 ) {
 	return *s1 == 0;
 }
 
+/**
+ * hash of a string, same value as str_hash_c
+ * allow NULL as parameter
+ */
+
+uint16_t str_hash( const char* s ) {
+	uint16_t h = STR_HASH_INIT;
+
+	if( s ) {
+		while( *s ) {
+			h = str_hash_step( h, *s++ );
+		}
+	}
+
+	return h;
+}
+
 /**
  * basic float to string conversion
  * the buffer must be big enough to contains the number
@@ -135,6 +152,28 @@ char* i_to_str( int n, char* dest ) {
 	return dest;
 }
 
+/**
+ * unsigned 32 bits to string conversion (timestamps, revisions)
+ * return last used character, cf. i_to_str
+ */
+
+char* u32_to_str( uint32_t n, char* dest ) {
+	char temp[10];
+	char* p = temp;
+
+	do {
+		*p++ = ( n % 10 ) + '0';
+		n /= 10;
+	} while( n );
+
+	do {
+		*dest++ = *--p;
+	} while( p != temp );
+
+	*dest = 0;
+	return dest;
+}
+
 /**
  * basic string to float conversion
  */
@@ -143,6 +182,16 @@ int str_to_i( const char* a ) {
 	return atoi( a );
 }
 
+/**
+ * basic string to unsigned 32 bits conversion
+ */
+
+uint32_t str_to_u32( const char* a ) {
+	// saturated where unsigned long is 64 bits
+	unsigned long v = strtoul( a, NULL, 10 );
+	return v > 0xFFFFFFFFul ? 0xFFFFFFFFul : (uint32_t)v;
+}
+
 /**
  * basic float to string conversion
  */
@@ -178,6 +227,74 @@ float round( float v, unsigned ndec, float rnd_spec ) {
 }
 
 
+/**
+ * crc16 ccitt
+ */
+
+uint16_t crc16( const uint8_t* data, size_t len, uint16_t crc ) {
+	while( len-- ) {
+		crc ^= (uint16_t)( *data++ ) << 8;
+		for( int i = 0; i < 8; i++ ) {
+			crc = ( crc & 0x8000 ) ? ( crc << 1 ) ^ 0x1021 : ( crc << 1 );
+		}
+	}
+
+	return crc;
+}
+
+/**
+ * COBS encoding
+ * each block starts with the offset of the next 0
+ */
+
+size_t cobs_encode( const uint8_t* src, size_t len, uint8_t* dest ) {
+	size_t out = 1;
+	size_t code_pos = 0;
+	uint8_t code = 1;
+
+	for( size_t i = 0; i < len; i++ ) {
+		if( src[i] ) {
+			dest[out++] = src[i];
+			code++;
+		}
+
+		if( !src[i] || code == 0xFF ) {
+			dest[code_pos] = code;
+			code = 1;
+			code_pos = out++;
+		}
+	}
+
+	dest[code_pos] = code;
+	return out;
+}
+
+/**
+ * COBS decoding
+ */
+
+size_t cobs_decode( const uint8_t* src, size_t len, uint8_t* dest ) {
+	size_t in = 0;
+	size_t out = 0;
+
+	while( in < len ) {
+		uint8_t code = src[in++];
+		if( !code || in + code - 1 > len ) {
+			return 0;
+		}
+
+		for( uint8_t i = 1; i < code; i++ ) {
+			dest[out++] = src[in++];
+		}
+
+		if( code != 0xFF && in < len ) {
+			dest[out++] = 0;
+		}
+	}
+
+	return out;
+}
+
 
 
 Value::Value( cstr s ) {
@@ -29,12 +29,55 @@ typedef const char*   cstr;
 
 bool  str_eq( const char* s1, const char* s2 );
 
+/**
+ * string hash (djb2, xor version), 16 bits
+ * str_hash_step can be used to compute it while receiving chars
+ * str_hash_c is the compile time version
+ */
+
+#define STR_HASH_INIT 5381
+
+constexpr uint16_t str_hash_step( uint16_t h, char ch ) {
+	return (uint16_t)( ( h << 5 ) + h ) ^ (uint8_t)ch;
+}
+
+constexpr uint16_t str_hash_c( const char* s, uint16_t h = STR_HASH_INIT ) {
+	return *s ? str_hash_c( s + 1, str_hash_step( h, *s ) ) : h;
+}
+
+uint16_t str_hash( const char* s );
+
+/**
+ * 32 bits string hash (FNV-1a), compile time
+ */
+
+#define STR_HASH32_INIT 2166136261u
+#define STR_HASH32_PRIME 16777619u
+
+constexpr uint32_t str_hash32_c( const char* s, uint32_t h = STR_HASH32_INIT ) {
+	return *s ? str_hash32_c( s + 1, ( h ^ (uint8_t)*s ) * STR_HASH32_PRIME ) : h;
+}
+
+/**
+ * compile time version of str_eq (exact match)
+ */
+
+constexpr bool str_eq_c( const char* s1, const char* s2 ) {
+	return *s1 == *s2 && ( *s1 == 0 || str_eq_c( s1 + 1, s2 + 1 ) );
+}
+
 /**
  * string to integrer
  */
 
 int   str_to_i( const char* s1 );
 
+/**
+ * string to unsigned 32 bits (revisions, timestamps, durations)
+ */
+
+uint32_t str_to_u32( const char* s1 );
+
 /**
  * string to float
  */
@@ -53,6 +96,12 @@ char* f_to_str( float number, int digits, char* buffer );
 
 char* i_to_str( int number, char* buffer );
 
+/**
+ * unsigned 32 bits to string, the buffer must have room for 11 chars
+ */
+
+char* u32_to_str( uint32_t number, char* buffer );
+
 /**
  * convert a nibble to a printable hex digit
  */
@@ -65,6 +114,27 @@ char  xtoa( uint8_t v );
 
 float round( float v, unsigned ndec, float rndv );
 
+/**
+ * crc16 ccitt (poly 0x1021, init 0xFFFF)
+ */
+
+uint16_t crc16( const uint8_t* data, size_t len, uint16_t crc = 0xFFFF );
+
+/**
+ * COBS encoding, the result does not contain any 0
+ * dest must be at least len + len/254 + 1 bytes
+ * @return encoded length
+ */
+
+size_t cobs_encode( const uint8_t* src, size_t len, uint8_t* dest );
+
+/**
+ * COBS decoding, can be done in place (src == dest)
+ * @return decoded length or 0 if the data is not valid
+ */
+
+size_t cobs_decode( const uint8_t* src, size_t len, uint8_t* dest );
+
 /**
  * generic value
  * this class is a small wrapper around a string value
@@ -0,0 +1,105 @@
+/**
+ * @file trace.cpp
+ * @desc Usis binary trace
+ *
+ * @author Etienne Cochard ecochard@r-libre.fr
+ * @version 1.0
+ **/
+
+#include "trace.h"
+#include "properties.h"
+
+#if TRACE_SIZE
+
+/**
+ * records ring, the next one is written at records[sequence % TRACE_SIZE]
+ */
+
+static TraceRecord records[TRACE_SIZE];
+static uint32_t sequence = 0; // records written since startup
+static uint8_t session = 0; // session number << 4
+static bool paused = false; // the trace is being sent
+
+/**
+ *
+ */
+
+void traceSession( uint8_t s ) {
+	session = s << 4;
+}
+
+/**
+ *
+ */
+
+static void record( uint32_t time, uint8_t event, uint8_t a, uint16_t b ) {
+	TraceRecord* r = &records[sequence++ % TRACE_SIZE];
+	r->time = time;
+	r->event = event | session;
+	r->a = a;
+	r->b = b;
+}
+
+void trace( uint8_t event, uint8_t a, uint16_t b ) {
+	if( !paused ) {
+		record( micros( ), event, a, b );
+	}
+}
+
+void traceSince( uint8_t event, uint8_t a, uint32_t start ) {
+	if( !paused ) {
+		const uint32_t now = micros( );
+		const uint32_t elapsed = now - start;
+		record( now, event, a, elapsed < 0xFFFF ? elapsed : 0xFFFF );
+	}
+}
+
+/**
+ * record as 16 hex digits, bytes in the wire order
+ */
+
+static unsigned formatRecord( char* item, const TraceRecord* r ) {
+	const uint8_t bytes[8] = {
+		(uint8_t)r->time, (uint8_t)( r->time >> 8 ), (uint8_t)( r->time >> 16 ), (uint8_t)( r->time >> 24 ),
+		r->event, r->a, (uint8_t)r->b, (uint8_t)( r->b >> 8 ),
+	};
+
+	char* p = item;
+	for( unsigned i = 0; i < sizeof( bytes ); i++ ) {
+		*p++ = xtoa( bytes[i] >> 4 );
+		*p++ = xtoa( bytes[i] & 0xf );
+	}
+
+	*p = 0;
+	return p - item;
+}
+
+/**
+ *
+ */
+
+int processTrace( Request*, Response* res ) {
+	paused = true;
+
+	uint32_t index = sequence > TRACE_SIZE ? sequence - TRACE_SIZE : 0;
+
+	// sequence on 32 bits (int is 16 bits on AVR)
+	char tag[11];
+	u32_to_str( index, tag );
+
+	for( ; index < sequence; index++ ) {
+		char item[17];
+		unsigned il = formatRecord( item, &records[index % TRACE_SIZE] );
+
+		if( appendItem( res, "TRACE", tag, item, il ) ) {
+			u32_to_str( index, tag );
+		}
+	}
+
+	endItems( res, "TRACE", tag );
+
+	paused = false;
+	return 0;
+}
+
+#endif
@@ -0,0 +1,90 @@
+/**
+ * @file trace.h
+ * @desc Usis binary trace
+ *
+ * @author Etienne Cochard ecochard@r-libre.fr
+ * @version 1.0
+ **/
+
+#ifndef __USIS_TRACE_H
+#define __USIS_TRACE_H
+
+#include "protocol.h"
+
+// count of records kept (8 bytes each), the oldest ones are overwritten
+// 0 disables the trace: the TRACE_xxx macros are empty and SYSTEM;TRACE is unknown
+// off by default on AVR (2KB of ram) and on the desktop build, where micros() calls gettimeofday()
+#ifndef TRACE_SIZE
+#	if defined( __AVR__ ) || defined( DESKTOPBM )
+#		define TRACE_SIZE 0
+#	else
+#		define TRACE_SIZE 128
+#	endif
+#endif
+
+/**
+ * events, the session number (order of creation, 15 for the ones above) is in the high nibble
+ */
+
+enum TraceEvent
+{
+	TRACE_FRAME = 1, // request received: a = CMD_xxx (0x80 | op for binary frames), b = length
+	TRACE_ERROR = 2, // communication error: a = xx of Cxx, b = bytes received
+	TRACE_DISPATCH = 3, // request processed: a = CMD_xxx (0x80 | op for binary frames), b = duration in us (saturated)
+	TRACE_RESPONSE = 4, // frame sent: a = status as in binary framing (0 M00, xx Mxx, 0x80 | xx Cxx, 0xFF EVT, 0xFE SMP), b = length
+};
+
+/**
+ * a record, sent as 8 bytes: time (little endian), event, a, b (little endian)
+ */
+
+struct TraceRecord
+{
+	uint32_t time; // micros()
+	uint8_t event; // TRACE_xxx | session << 4
+	uint8_t a;
+	uint16_t b;
+};
+
+#if TRACE_SIZE
+
+/**
+ * session of the next records, set when a session is processed
+ */
+
+void traceSession( uint8_t session );
+
+/**
+ * append a record
+ */
+
+void trace( uint8_t event, uint8_t a, uint16_t b );
+
+/**
+ * append a record, b is the time since start (us, saturated)
+ */
+
+void traceSince( uint8_t event, uint8_t a, uint32_t start );
+
+/**
+ * handle SYSTEM;TRACE, records are sent from the oldest in one or more frames:
+ * 	M00;TRACE;<sequence of the first record>;<MORE|OK>;<16 hex digits>,...
+ * the sequence counts the records since startup, the host can see the ones lost
+ * nothing is recorded while the trace is sent
+ */
+
+int processTrace( Request* req, Response* res );
+
+#	define TRACE_SESSION( session ) traceSession( session )
+#	define TRACE( event, a, b ) trace( event, a, b )
+#	define TRACE_SINCE( event, a, start ) traceSince( event, a, start )
+
+#else
+
+#	define TRACE_SESSION( session )
+#	define TRACE( event, a, b )
+#	define TRACE_SINCE( event, a, start )
+
+#endif
+
+#endif